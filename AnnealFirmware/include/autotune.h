@@ -0,0 +1,17 @@
+#pragma once
+#include <Arduino.h>
+
+//Relay-feedback (Astrom-Hagglund) PID autotuner.
+//Each heater is switched between bias+amplitude and bias-amplitude duty
+//whenever its thermocouple crosses the setpoint, which makes the zone
+//oscillate. The oscillation's amplitude a and period Tu give the ultimate
+//gain Ku = 4*amplitude/(pi*a); Tyreus-Luyben rules turn Ku and Tu into gains.
+
+#define AUTOTUNE_AMPLITUDE 50 //default relay amplitude, % duty
+
+void autotune_start(float amplitude, bool save);
+void autotune_stop();
+bool autotune_running();
+//call once per control period in place of the PID update: sets duty_A and
+//duty_B, and installs the gains when both channels have settled
+void autotune_update();
@@ -5,7 +5,10 @@
 
 void serial_tx();
 void error_tx();
+void health_tx();
+void memory_tx();
 void serial_rx();
 bool parse_rx();
+void save_gains();
 
 void reboot();
\ No newline at end of file
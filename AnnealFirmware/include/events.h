@@ -0,0 +1,15 @@
+#pragma once
+#include <Arduino.h>
+
+//What wakes the main loop. Between events the MCU sits in idle sleep: Timer0
+//(millis), the UART, SPI and the pin-change interrupts keep running and
+//wake it up again.
+
+#define EV_TICK 0x01  //millis() moved on (Timer0 overflow, ~1ms)
+#define EV_DRDY 0x02  //ADC pulled DRDY low: conversion ready
+#define EV_RX 0x04    //bytes waiting in the UART receive buffer
+#define EV_FAULT 0x08 //a heater sense line changed (fuse, supply, E-STOP)
+
+void events_begin();
+//sleeps until at least one event is pending, then returns all that are
+uint8_t events_wait();
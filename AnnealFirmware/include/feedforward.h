@@ -0,0 +1,17 @@
+#pragma once
+#include <Arduino.h>
+
+//Feed-forward for the per-zone PIDs. Each zone follows the static model
+//T = T0 + K * duty: T0 is where it settles with its heater off (the cold
+//sink), K the rise per % duty. The duty the model says a setpoint needs is
+//added to the PID output, so after a setpoint step the heater lands near
+//steady state at once and the integral only holds the model's error.
+//While a zone sits at its setpoint, T0 is nudged towards what the applied
+//duty says it is, which tracks a drifting sink.
+
+void ff_begin(); //models from EEPROM
+void ff_save();
+//K in degC per % duty; K=0 turns the channel's feed-forward off
+bool ff_set_model(uint8_t channel, float K, float T0);
+//call once per control period before the per-zone PID updates: sets ff_A and ff_B
+void ff_update();
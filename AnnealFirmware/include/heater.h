@@ -1,20 +1,37 @@
 #pragma once
 #include <Arduino.h>
 
+#define HEATER_POWER_W 120 //one channel switched fully on
+
 class Heater
 {
 private:
     uint8_t switch_pin, sense_pin;
     uint8_t duty; //0-100% time on
     uint16_t on_time_ms;
+    uint16_t on_start_ms; //where in the period the on-time begins
+    bool on;      //switch pin level
     bool powered;
 
 public:
     Heater(uint8_t switch_pin, uint8_t sense_pin) : switch_pin(switch_pin), sense_pin(sense_pin){};
     void begin();
-    void update(uint16_t ms);
+    void update(uint16_t ms); //switches the heater when the period position says so
+    void sense();             //reads the fuse sense line again
     void shutdown();
     void set_duty(uint8_t duty);
+    void set_phase(uint16_t start_ms);
     uint8_t get_duty();
+    uint16_t get_on_time();
     bool has_power();
-};
\ No newline at end of file
+};
+
+//Staggers the heaters' on-times within the period: each channel starts where
+//the one before it stops, so they only conduct together when the duties add
+//up to more than 100%. If that would draw more than the peak power budget,
+//the duties are scaled down until it doesn't. Returns the fraction of the
+//asked-for duty they got, 1 unless the budget cut them. Call after
+//set_duty(); the phases count from where update() is given 0.
+float heaters_schedule(Heater *const heaters[], uint8_t n);
+void heaters_set_budget(uint16_t watts); //0xFFFF = no limit
+uint16_t heaters_get_budget();
\ No newline at end of file
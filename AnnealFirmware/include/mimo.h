@@ -0,0 +1,25 @@
+#pragma once
+#include <Arduino.h>
+
+//Coupled two-zone control. Instead of one PID per heater, one PID holds the
+//mean of the two zones and another the gradient (A - B). The coupling
+//matrix K (steady-state zone rise per % of each heater's duty, from step
+//tests) is inverted so that the mean loop's output moves only the mean and
+//the gradient loop's output only the gradient.
+
+void mimo_begin(); //coupling matrix from EEPROM
+void mimo_save();
+//<DCM,kAA,kAB,kBA,kBB>; false if the zones can't be told apart with it
+bool mimo_set_coupling(float kAA, float kAB, float kBA, float kBB);
+void mimo_set_gains(float Kp, float Ki, float Kd);
+
+void mimo_enable(float gradient); //mean setpoint is goal_temp
+void mimo_disable();
+bool mimo_enabled();
+float mimo_gradient_setpoint();
+
+//call once per control period in place of the PID updates: sets duty_A and duty_B
+void mimo_run();
+//the fraction of duty_A and duty_B the heaters got (heaters_schedule), so the
+//mean loop stops integrating what the power budget won't give it
+void mimo_limit(float granted);
@@ -0,0 +1,198 @@
+#pragma once
+//The serial protocol, for the firmware and the host tools alike (HostTools
+//builds with AnnealFirmware/include on its include path). The tables below
+//are the only place command names, their arguments and the <DAT> field order
+//are spelled out: the firmware decodes commands and encodes <DAT> from them,
+//the host library encodes commands and decodes <DAT> from them, so the two
+//sides can't drift apart. Header-only and C++11, for avr-gcc.
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Commands <TAG,arg,...>: X(tag, fewest args, most args, zone args)
+//zone args has bit i set where argument i is a zone letter (A or B) rather
+//than a number. What each command does is listed in comms.cpp.
+#define PROTOCOL_COMMANDS(X) \
+    X(SET, 1, 1, 0x00)       \
+    X(OFF, 0, 0, 0x00)       \
+    X(RST, 0, 0, 0x00)       \
+    X(PID, 3, 3, 0x00)       \
+    X(SAV, 0, 0, 0x00)       \
+    X(NOP, 0, 0, 0x00)       \
+    X(ATN, 0, 2, 0x00)       \
+    X(GRD, 2, 2, 0x00)       \
+    X(DCM, 4, 4, 0x00)       \
+    X(GSE, 5, 5, 0x00)       \
+    X(GSN, 1, 2, 0x00)       \
+    X(PWR, 1, 1, 0x00)       \
+    X(HLT, 0, 0, 0x00)       \
+    X(MEM, 0, 0, 0x00)       \
+    X(FFM, 3, 3, 0x01)       \
+    X(BCL, 0, 0, 0x00)
+
+#define PROTO_MAX_ARGS 5
+
+enum ProtoCommand : uint8_t
+{
+#define PROTO_ENUM(tag, least, most, zones) PROTO_##tag,
+    PROTOCOL_COMMANDS(PROTO_ENUM)
+#undef PROTO_ENUM
+        PROTO_UNKNOWN
+};
+
+//A command may end in a sequence number, <SET,-200.0,#17>. The firmware then
+//answers it at once: <ACK,17,SET,applied value...> or <NAK,17,PROTO_NAK_*>.
+//Without one it stays silent, like firmware from before.
+#define PROTO_NO_SEQ -1
+#define PROTO_SEQ_MAX 0xFFFF
+#define PROTO_NAK_INVALID 1 //unknown command, or the wrong arguments for it
+#define PROTO_NAK_REFUSED 2 //understood, but the value was refused
+
+//decoded command: zone letters come out as 0 (A) or 1 (B)
+struct Command
+{
+    uint8_t id;      //PROTO_*
+    const char *tag; //points into the decoded text
+    int32_t seq;     //PROTO_NO_SEQ if none
+    uint8_t argc;
+    float arg[PROTO_MAX_ARGS];
+};
+
+//the three letters of a tag as one number, so finding a command is a switch
+//on constants rather than a string compare per command
+constexpr uint32_t proto_key(const char *tag)
+{
+    return (uint32_t)(uint8_t)tag[0] << 16 | (uint32_t)(uint8_t)tag[1] << 8 | (uint8_t)tag[2];
+}
+
+inline uint8_t proto_lookup(const char *tag)
+{
+    switch (proto_key(tag))
+    {
+#define PROTO_CASE(tag, least, most, zones) \
+    case proto_key(#tag):                   \
+        return PROTO_##tag;
+        PROTOCOL_COMMANDS(PROTO_CASE)
+#undef PROTO_CASE
+    }
+    return PROTO_UNKNOWN;
+}
+
+inline const char *proto_tag(uint8_t id)
+{
+    switch (id)
+    {
+#define PROTO_CASE(tag, least, most, zones) \
+    case PROTO_##tag:                       \
+        return #tag;
+        PROTOCOL_COMMANDS(PROTO_CASE)
+#undef PROTO_CASE
+    }
+    return "";
+}
+
+//true if argc arguments are right for the command
+inline bool proto_argc_ok(uint8_t id, uint8_t argc)
+{
+    switch (id)
+    {
+#define PROTO_CASE(tag, least, most, zones) \
+    case PROTO_##tag:                       \
+        return argc >= least && argc <= most;
+        PROTOCOL_COMMANDS(PROTO_CASE)
+#undef PROTO_CASE
+    }
+    return false;
+}
+
+inline bool proto_is_zone_arg(uint8_t id, uint8_t i)
+{
+    switch (id)
+    {
+#define PROTO_CASE(tag, least, most, zones) \
+    case PROTO_##tag:                       \
+        return (zones) >> i & 1;
+        PROTOCOL_COMMANDS(PROTO_CASE)
+#undef PROTO_CASE
+    }
+    return false;
+}
+
+//Decodes the text between < and >, which is cut up in place (commas become
+//terminators). False for an unknown tag, the wrong number of arguments or an
+//argument that isn't what the table says. The sequence number is taken off
+//first, so a command that fails to decode can still be answered.
+inline bool proto_decode(char *text, Command &c)
+{
+    c.seq = PROTO_NO_SEQ;
+    char *last = strrchr(text, ',');
+    if (last && last[1] == '#')
+    {
+        char *end;
+        unsigned long seq = strtoul(last + 2, &end, 10);
+        if (end == last + 2 || *end || seq > PROTO_SEQ_MAX)
+        {
+            return false;
+        }
+        c.seq = seq;
+        *last = '\0';
+    }
+    char *field = strtok(text, ",");
+    if (!field || strlen(field) != 3) //tags are three letters
+    {
+        return false;
+    }
+    c.id = proto_lookup(field);
+    c.tag = field;
+    c.argc = 0;
+    while ((field = strtok(NULL, ",")) != NULL)
+    {
+        if (c.argc == PROTO_MAX_ARGS)
+        {
+            return false;
+        }
+        if (proto_is_zone_arg(c.id, c.argc))
+        {
+            if ((field[0] != 'A' && field[0] != 'B') || field[1])
+            {
+                return false;
+            }
+            c.arg[c.argc++] = field[0] - 'A';
+        }
+        else
+        {
+            char *end;
+            c.arg[c.argc++] = strtod(field, &end);
+            if (end == field || *end)
+            {
+                return false;
+            }
+        }
+    }
+    return c.id != PROTO_UNKNOWN && proto_argc_ok(c.id, c.argc);
+}
+
+//Status packet <DAT,...>, once per period: X(field, decimals sent)
+#define PROTOCOL_DAT_FIELDS(X) \
+    X(uptime, 2)   /*s since boot*/                                    \
+    X(setpoint, 2) /*degC, for both zones (their mean under <GRD>)*/   \
+    X(temp_A, 2)   /*degC*/                                            \
+    X(temp_B, 2)                                                       \
+    X(internal, 2) /*degC, ADC (cold junction)*/                       \
+    X(duty_A, 0)   /*% heater duty*/                                   \
+    X(duty_B, 0)                                                       \
+    X(Kp, 5)       /*PID gains in use*/                                \
+    X(Ki, 5)                                                           \
+    X(Kd, 5)                                                           \
+    X(gradient, 2) /*degC, A - B setpoint under <GRD>, 0 otherwise*/
+
+#define PROTO_DAT_MIN_FIELDS 10 //firmware before <GRD> sent no gradient
+
+struct DatFrame
+{
+#define PROTO_FIELD(name, decimals) float name;
+    PROTOCOL_DAT_FIELDS(PROTO_FIELD)
+#undef PROTO_FIELD
+};
+
+#define PROTO_DAT_FIELDS (sizeof(DatFrame) / sizeof(float))
@@ -0,0 +1,13 @@
+#pragma once
+#include <Arduino.h>
+
+//RAM headroom on the 2KB ATmega328.
+//Everything above the static data (.data, .bss and the heap, which nothing
+//uses) is painted before main() runs; the stack leaves its mark as it grows
+//down into the paint. <MEM> reports the numbers below.
+
+#define RAM_PAINT 0xC5
+
+uint16_t ram_static();   //bytes of .data and .bss
+uint16_t ram_free();     //bytes between the heap and the stack pointer right now
+uint16_t ram_free_min(); //fewest there have been since boot: paint the stack never reached
@@ -0,0 +1,27 @@
+#pragma once
+#include <Arduino.h>
+
+//Gain schedule: PID gains as a function of temperature. Between breakpoints
+//the gains are interpolated linearly, beyond the outermost ones they stay at
+//that breakpoint's values. Gains change bumplessly, once per control period.
+
+#define SCHEDULE_MAX 6
+#define SCHEDULE_BY_SETPOINT 0 //look the gains up at the setpoint
+#define SCHEDULE_BY_TEMP 1     //at each zone's measured temperature
+
+struct GainPoint
+{
+    float temp; //degC
+    float Kp, Ki, Kd;
+};
+
+void schedule_begin(); //table from EEPROM
+void schedule_save();
+bool schedule_set_point(uint8_t i, float temp, float Kp, float Ki, float Kd);
+//use breakpoints 0..n-1; n=0 turns the schedule off
+bool schedule_enable(uint8_t n, uint8_t source);
+void schedule_disable();
+bool schedule_enabled();
+//call once per control period before the PID updates: sets Kp, Ki and Kd
+//(the gains at the setpoint, or at the mean zone temperature) and the loops' gains
+void schedule_update();
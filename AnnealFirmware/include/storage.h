@@ -0,0 +1,14 @@
+#pragma once
+#include "schedule.h"
+
+//EEPROM layout. Erased cells read 0xFF, which is NaN as a float.
+#define EE_KP 0                                         //float, PID gains
+#define EE_KI (EE_KP + sizeof(float))                   //float
+#define EE_KD (EE_KI + sizeof(float))                   //float
+#define EE_COUPLING (EE_KD + sizeof(float))             //float[2][2], degC per % duty [zone][heater]
+#define EE_SCHEDULE_N (EE_COUPLING + 4 * sizeof(float)) //uint8_t, breakpoints in use, 0=off
+#define EE_SCHEDULE_SRC (EE_SCHEDULE_N + 1)             //uint8_t, SCHEDULE_BY_*
+#define EE_SCHEDULE (EE_SCHEDULE_SRC + 1)               //GainPoint[SCHEDULE_MAX]
+#define EE_POWER_BUDGET (EE_SCHEDULE + SCHEDULE_MAX * sizeof(GainPoint)) //uint16_t, W, 0xFFFF=no limit
+#define EE_FEEDFORWARD (EE_POWER_BUDGET + sizeof(uint16_t))    //float[2][2], {K, T0} per zone
+#define EE_BURNOUT (EE_FEEDFORWARD + 4 * sizeof(float))     //int16_t[2], burnout check baseline counts per zone, <=0=none
@@ -11,22 +11,78 @@ void adc_init();
 #define ADC_CHANNEL_INTERNAL_TEMP 1
 #define ADC_CHANNEL_TC_A 2
 #define ADC_CHANNEL_TC_B 3
+//the same inputs with the 10uA burnout current sources on, for adc_store():
+//classifies the thermocouple as open or shorted against its last reading
+#define ADC_CHANNEL_BURNOUT_A 4
+#define ADC_CHANNEL_BURNOUT_B 5
 void adc_select_channel(uint8_t channel);
 void adc_start_conversion();
 bool adc_is_conversion_ready();
 int16_t adc_read_conversion();
 
-float adc_to_internal_temp(int16_t adc);
-float adc_to_thermocouple_temp(int16_t adc, float internal_temp);
+//Conversion with link checking: once DRDY falls the result is read and the
+//config registers are read back. If they don't match what was written, or
+//DRDY never falls, the ADC is reset and set up again in place and the
+//caller starts its conversion sequence over.
+#define ADC_BUSY 0  //still converting
+#define ADC_DONE 1  //result in adc
+#define ADC_FAULT 2 //nothing to read: ADC was reset, select a channel and start again
+uint8_t adc_poll(int16_t &adc);
+
+struct AdcHealth
+{
+    uint16_t timeouts;        //conversions that never pulled DRDY low
+    uint16_t readback_errors; //config registers that didn't read back as written
+    uint16_t resets;          //in-place resets and reconfigurations
+};
+const AdcHealth &adc_get_health();
+
+//Conversions are kept as counts and range checked in counts as they come
+//in (setting the *_WILD flags); degrees are only worked out by adc_temp(),
+//0 for a wild channel (or one that failed its burnout check). Store the
+//internal temperature before the thermocouples it references, and a
+//thermocouple before its burnout check.
+void adc_store(uint8_t channel, int16_t adc);
+float adc_temp(uint8_t channel);
 
 //these bounds are used to indicate errors with the readings
 #define TC_MAX_TEMP 50      //temperatures above this not expected for thermocouples
 #define TC_MIN_TEMP -273    //temperatures below this not expected for thermocouples
 #define INTERNAL_MIN_TEMP 3 //temperatures below this not expected for the ADC
 
+#define ADC_TIMEOUT 100    //ms; a conversion takes 50ms at 20SPS
+#define ADC_LINK_RETRIES 3 //resets before the link counts as broken
+
+//burnout check: the 10uA current sources run through the 1k resistor in
+//each input leg on the amp board (R5/R6 on A, R7/R8 on B) and the
+//thermocouple. An intact one reads 20mV plus its own EMF and 10uA times its
+//loop resistance: gain 64 (+-32mV) keeps that in range, where gain 128
+//would saturate. An open one lets the sources pull the inputs apart to full
+//scale. A short at the feedthrough or in the cable takes the loop resistance
+//out, but that is only a percent or two of what the resistors add, less
+//than their tolerance: so it is caught as a drop below a baseline each
+//channel learns with its thermocouple intact (<BCL>), kept in EEPROM.
+//Without one, only open thermocouples are flagged. Counts are at BURNOUT_GAIN.
+#define BURNOUT_GAIN 64
+#define BURNOUT_OPEN_COUNTS 30000 //of 32767; an intact loop reads at most ~25000
+#define TC_SHORT_DROP_OHMS 10     //less loop resistance than the baseline by this much is a short
+#define BURNOUT_LEARN_CHECKS 8    //averaged into a baseline
+
+//Learns both channels' baselines from the next BURNOUT_LEARN_CHECKS checks,
+//stores them and sends <BCL,OK,ohms A,ohms B> (what the sources see through
+//the resistors and the thermocouple). If a thermocouple reads open meanwhile
+//it sends <BCL,FAIL> and keeps the old ones.
+void adc_burnout_learn();
+
 //error flags by bit index:
-#define ADC_ERR_BAD_SPI 0x01            //config register write failed OR called
+#define ADC_ERR_BAD_SPI 0x01            //SPI link failed ADC_LINK_RETRIES times in a row
 #define ADC_ERR_INTERNAL_TEMP_WILD 0x02 //out of range internal temp value
 #define ADC_ERR_TEMP_A_WILD 0x04        //A channel is reading unreasonably high or low
 #define ADC_ERR_TEMP_B_WILD 0x08        //B channel
+#define ADC_ERR_OPEN_A 0x10             //A thermocouple open (burnout check)
+#define ADC_ERR_OPEN_B 0x20
+#define ADC_ERR_SHORT_A 0x40            //A thermocouple shorted (burnout check)
+#define ADC_ERR_SHORT_B 0x80
+#define ADC_ERR_BURNOUT_A (ADC_ERR_OPEN_A | ADC_ERR_SHORT_A)
+#define ADC_ERR_BURNOUT_B (ADC_ERR_OPEN_B | ADC_ERR_SHORT_B)
 uint8_t adc_get_errcode();
\ No newline at end of file
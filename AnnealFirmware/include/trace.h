@@ -0,0 +1,24 @@
+#pragma once
+#include <Arduino.h>
+
+//Latency trace points along the command path.
+//native build: timestamped by the simulator (program --bench N)
+//board: build with -DLATENCY_PIN=2 and every trace point toggles that pin,
+//so a scope on it and on a heater gate shows the time between them
+//otherwise: no code at all
+
+#define TRACE_RX_COMPLETE 1 //end marker of a command taken out of the UART buffer
+#define TRACE_PARSED 2      //command acted upon
+#define TRACE_PID_RUN 3     //PID outputs recalculated
+
+#if defined(ANNEAL_SIM)
+void trace_point(uint8_t point);
+#define TRACE_BEGIN()
+#define TRACE(point) trace_point(point)
+#elif defined(LATENCY_PIN)
+#define TRACE_BEGIN() pinMode(LATENCY_PIN, OUTPUT)
+#define TRACE(point) digitalWrite(LATENCY_PIN, !digitalRead(LATENCY_PIN))
+#else
+#define TRACE_BEGIN()
+#define TRACE(point)
+#endif
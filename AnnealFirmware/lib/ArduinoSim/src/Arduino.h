@@ -0,0 +1,104 @@
+#pragma once
+//Host-native stand-in for the parts of the Arduino core the firmware uses.
+//Only built for the native environment - see sim.h for the simulated hardware.
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <cmath>
+#include <type_traits>
+#include "avr/pgmspace.h"
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define PI 3.1415926535897932384626433832795
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+using std::abs;
+//functions rather than the core's macros, which would break <algorithm>
+template <class T, class U>
+typename std::common_type<T, U>::type min(T a, U b) { return a < b ? a : b; }
+template <class T, class U>
+typename std::common_type<T, U>::type max(T a, U b) { return a > b ? a : b; }
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+//pin-change interrupt registers and the UNO's pin mapping onto them (pins_arduino.h);
+//the simulator raises PCINTn_vect itself when an enabled pin changes level
+#define _BV(bit) (1 << (bit))
+extern uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+#define digitalPinToPCICR(p) (((p) >= 0 && (p) <= 21) ? (&PCICR) : ((uint8_t *)0))
+#define digitalPinToPCICRbit(p) (((p) <= 7) ? 2 : (((p) <= 13) ? 0 : 1))
+#define digitalPinToPCMSK(p) (((p) <= 7) ? (&PCMSK2) : (((p) <= 13) ? (&PCMSK0) : (((p) <= 21) ? (&PCMSK1) : ((uint8_t *)0))))
+#define digitalPinToPCMSKbit(p) (((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : ((p) - 14)))
+
+//string literals kept in flash (WString.h)
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(PSTR(string_literal)))
+
+//Subset of Arduino's Print, formatting numbers exactly like the AVR core
+//(floats are rounded in single precision, as double == float there)
+class Print
+{
+public:
+    virtual size_t write(uint8_t c) = 0;
+    size_t write(const char *str);
+
+    size_t print(const __FlashStringHelper *str);
+    size_t print(const char *str);
+    size_t print(char c);
+    size_t print(unsigned char n, int base = DEC);
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+
+    size_t println();
+    size_t println(const __FlashStringHelper *str);
+    size_t println(const char *str);
+    size_t println(char c);
+    size_t println(unsigned char n, int base = DEC);
+    size_t println(int n, int base = DEC);
+    size_t println(unsigned int n, int base = DEC);
+    size_t println(long n, int base = DEC);
+    size_t println(unsigned long n, int base = DEC);
+    size_t println(double n, int digits = 2);
+
+private:
+    size_t print_number(unsigned long n, uint8_t base);
+    size_t print_float(float number, uint8_t digits);
+};
+
+class HardwareSerial : public Print
+{
+public:
+    void begin(unsigned long baud);
+    int available();
+    int read();
+    size_t write(uint8_t c) override;
+    using Print::write;
+    void flush(); //waits until the last byte has left the UART
+};
+
+extern HardwareSerial Serial;
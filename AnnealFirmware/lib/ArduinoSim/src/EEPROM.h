@@ -0,0 +1,48 @@
+#pragma once
+//Host-native stand-in for the AVR EEPROM library.
+//Starts erased (0xFF) like a blank ATmega328, or is backed by a file (--eeprom).
+#include <Arduino.h>
+
+#define SIM_EEPROM_SIZE 1024
+
+bool sim_eeprom_open(const char *path);
+uint8_t *sim_eeprom_data();
+void sim_eeprom_commit(int idx, int len);
+
+class EEPROMClass
+{
+public:
+    uint8_t read(int idx) { return sim_eeprom_data()[idx]; }
+    void write(int idx, uint8_t val)
+    {
+        sim_eeprom_data()[idx] = val;
+        sim_eeprom_commit(idx, 1);
+    }
+    void update(int idx, uint8_t val)
+    {
+        if (read(idx) != val)
+        {
+            write(idx, val);
+        }
+    }
+    uint16_t length() { return SIM_EEPROM_SIZE; }
+
+    template <typename T>
+    T &get(int idx, T &t)
+    {
+        memcpy(&t, sim_eeprom_data() + idx, sizeof(T));
+        return t;
+    }
+    template <typename T>
+    const T &put(int idx, const T &t)
+    {
+        const uint8_t *src = (const uint8_t *)&t;
+        for (size_t i = 0; i < sizeof(T); i++)
+        {
+            update(idx + i, src[i]);
+        }
+        return t;
+    }
+};
+
+extern EEPROMClass EEPROM;
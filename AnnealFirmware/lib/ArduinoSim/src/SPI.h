@@ -0,0 +1,35 @@
+#pragma once
+//Host-native stand-in for the Arduino SPI library.
+//Every transfer goes to the simulated ADS1120 (the only device on the bus).
+#include <Arduino.h>
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+#define MSBFIRST 1
+#define LSBFIRST 0
+
+class SPISettings
+{
+public:
+    SPISettings() {}
+    SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) : clock(clock), bitOrder(bitOrder), dataMode(dataMode) {}
+    uint32_t clock = 4000000;
+    uint8_t bitOrder = MSBFIRST;
+    uint8_t dataMode = SPI_MODE0;
+};
+
+class SPIClass
+{
+public:
+    void begin();
+    void end();
+    void setDataMode(uint8_t mode);
+    void beginTransaction(SPISettings settings);
+    void endTransaction();
+    uint8_t transfer(uint8_t data);
+};
+
+extern SPIClass SPI;
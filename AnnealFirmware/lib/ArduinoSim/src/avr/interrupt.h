@@ -0,0 +1,12 @@
+#pragma once
+//Host-native stand-in for avr/interrupt.h. Nothing preempts the firmware in
+//the simulation, so there is nothing to mask: handlers run from sleep_cpu()
+//(see sim_core.cpp), which is where the MCU would take them too.
+
+#define cli()
+#define sei()
+#define ISR(vector) void vector()
+
+void PCINT0_vect(); //pins 8-13
+void PCINT1_vect(); //A0-A5
+void PCINT2_vect(); //pins 0-7
@@ -0,0 +1,14 @@
+#pragma once
+//Host-native stand-in for avr/pgmspace.h: there is one address space on the
+//host, so flash data is ordinary const data and reading it is a dereference.
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+#define pgm_read_byte(addr) (*(const unsigned char *)(addr))
+#define pgm_read_word(addr) (*(const unsigned short *)(addr))
+#define pgm_read_float(addr) (*(const float *)(addr))
+
+#define strcmp_P(a, b) strcmp((a), (b))
+#define strlen_P(s) strlen(s)
@@ -0,0 +1,11 @@
+#pragma once
+//Host-native stand-in for avr/sleep.h: sleep_cpu() moves the simulation on to
+//the next thing that would wake the MCU, and runs the interrupts it raises.
+
+#define SLEEP_MODE_IDLE 0
+
+inline void set_sleep_mode(unsigned char mode) { (void)mode; }
+inline void sleep_enable() {}
+inline void sleep_disable() {}
+void sim_sleep_cpu();
+#define sleep_cpu() sim_sleep_cpu()
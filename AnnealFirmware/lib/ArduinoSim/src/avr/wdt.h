@@ -0,0 +1,15 @@
+#pragma once
+//Host-native stand-in for avr/wdt.h: arming the watchdog restarts the simulated MCU.
+
+#define WDTO_15MS 0
+#define WDTO_30MS 1
+#define WDTO_60MS 2
+#define WDTO_120MS 3
+#define WDTO_250MS 4
+#define WDTO_500MS 5
+#define WDTO_1S 6
+#define WDTO_2S 7
+
+[[noreturn]] void wdt_enable(unsigned char timeout);
+inline void wdt_disable() {}
+inline void wdt_reset() {}
@@ -0,0 +1,103 @@
+#pragma once
+//Simulated annealing box for the native firmware build:
+//UART on a pseudo-terminal (or stdio), ADS1120 on the SPI bus,
+//two MOSFET heaters and the two-zone target holder they heat.
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace sim
+{
+//time since simulated power-on, microseconds
+uint64_t now_us();
+void clock_begin();
+//virtual time (replay): the clock only moves when the simulation moves it,
+//so hours of operation run in seconds
+void clock_set_virtual();
+bool clock_is_virtual();
+void advance_us(uint64_t us);
+
+//thermal plant: each zone is first-order plus dead time, and each heater
+//also warms the opposite zone through the target holder.
+//zone/heater index 0 is channel A, 1 is channel B
+struct PlantParams
+{
+    float tau[2] = {60.0, 60.0};                 //zone time constant, s
+    float dead[2] = {2.0, 2.0};                  //heater->thermocouple dead time, s
+    float K[2][2] = {{1.0, 0.3}, {0.3, 1.0}};    //zone rise per % heater duty, degC/% [zone][heater]
+    float T0[2] = {-260.0, -260.0};              //zone temperature with both heaters off, degC
+    float T_cj = 25.0;                           //ADC die (cold-junction) temperature, degC
+};
+//reads "key = value" lines (tau_A, dead_B, K_AB, T0_A, T_cj, ...)
+bool load_plant_params(const char *path, PlantParams &params, std::string &err);
+void plant_begin(const PlantParams &params);
+void plant_set_heater(uint8_t heater, bool on);
+float plant_zone_temp(uint8_t zone);
+float plant_cj_temp();
+//instead of the model, play back measured temperatures; each sample holds
+//until the next one
+struct PlantSample
+{
+    uint64_t t_us;
+    float zone[2], cj;
+};
+void plant_follow(const std::vector<PlantSample> &samples);
+
+//type T thermocouple EMF referenced to 0degC (ITS-90), microvolts
+float type_t_uV(float temp);
+
+//ADS1120 behind the SPI stand-in
+void ads_power_on();
+uint8_t ads_transfer(uint8_t in);
+bool ads_drdy_low();
+//when a conversion in progress will pull DRDY low, UINT64_MAX if none is
+uint64_t ads_ready_at_us();
+
+//UART: bytes from the host are paced at the line rate into the 64 byte
+//receive ring, overflowing exactly like the AVR core does
+void serial_attach(int rx_fd, int tx_fd);
+void serial_poll();
+//puts host bytes on the wire behind anything already in flight
+void serial_inject(const char *data, size_t len);
+//called for every byte the firmware transmits, at the time it is queued
+void serial_set_tx_hook(void (*hook)(uint8_t c));
+
+//injected hardware faults
+struct Faults
+{
+    bool fuse_blown[2];      //heater sense line reads LOW
+    bool tc_open[2];         //thermocouple wire broken
+    bool tc_short[2];        //thermocouple leads touching at the feedthrough
+    uint64_t adc_hang_until; //ADC ignores the SPI bus until then, us
+};
+extern Faults faults;
+
+//replays the host side of a recorded session (see sim_replay.cpp) at virtual
+//time, then compares the firmware's <DAT>/<ERR> packets with the recorded ones.
+//returns the process exit code: 0 if they match, 1 if not, 2 on bad input
+struct ReplayOptions
+{
+    const char *path;
+    uint32_t loop_us;     //virtual time one pass through loop() costs
+    bool verbose;         //echo the replayed traffic
+    unsigned segment;     //boot of the recording to start at
+    unsigned mismatches;  //differences found before the last reset
+    bool seed_gains;      //put the first recorded PID gains in the EEPROM
+};
+int replay(const ReplayOptions &opts);
+//called on a watchdog reset during a replay: finishes the current boot and
+//returns the arguments that carry on with the next one, or exits if none is left
+std::vector<std::string> replay_next_segment();
+bool replaying();
+
+//latency benchmark: sends <SET> and <OFF> at random points of the control
+//period in virtual time and reports how long each stage of the command path
+//(trace.h, plus the UART and heater pins seen from here) takes to get to it
+#define TRACE_UART_END 0x10    //a '>' clocked into the receive ring
+#define TRACE_HEATER_EDGE 0x11 //a heater switch changed state
+void trace_at(uint8_t point, uint64_t t_us);
+int bench(unsigned commands, uint32_t loop_us);
+
+//watchdog reset: re-executes the simulator, keeping the UART attached
+[[noreturn]] void reset();
+} // namespace sim
@@ -0,0 +1,178 @@
+//ADS1120 as seen from the SPI bus with DRDYM=1 (DOUT/DRDY shared on MISO)
+#include "sim.h"
+#include <math.h>
+#include <deque>
+
+#define ADS_CMD_RESET 0x06    //0000 011x
+#define ADS_CMD_START 0x08    //0000 100x
+#define ADS_CMD_POWERDOWN 0x02 //0000 001x
+#define ADS_CMD_RDATA 0x10    //0001 xxxx
+#define ADS_CMD_RREG 0x20     //0010 rrnn
+#define ADS_CMD_WREG 0x40     //0100 rrnn
+
+#define ADS_VREF 2.048
+#define ADS_BURNOUT_UA 10 //current sources, REG1 bit 0
+#define SERIES_OHMS 2024  //1k 1% in each input leg on the amp board, these ones on the high side
+#define TC_LOOP_OHMS 40   //thermocouple there and back, cryostat wiring
+
+static uint8_t regs[4];
+static bool converting, data_ready;
+static uint64_t ready_at_us;
+static int16_t result;
+static std::deque<uint8_t> dout;  //bytes the device shifts out on the next transfers
+static uint8_t wreg_addr, wreg_left; //pending WREG data bytes
+
+void sim::ads_power_on()
+{
+    for (uint8_t &r : regs)
+    {
+        r = 0;
+    }
+    converting = data_ready = false;
+    dout.clear();
+    wreg_left = 0;
+}
+
+static uint32_t conversion_time_us()
+{
+    //normal mode data rates; the firmware runs single-shot at 20SPS
+    static const uint16_t sps[] = {20, 45, 90, 175, 330, 600, 1000, 1000};
+    return 1000000UL / sps[regs[1] >> 5] + 100;
+}
+
+static int16_t sample()
+{
+    if (regs[1] & 0x02)
+    {
+        //temperature sensor mode: 14-bit left-justified, 0.03125degC/LSB
+        return (int16_t)(lround(sim::plant_cj_temp() / 0.03125) << 2);
+    }
+    uint8_t mux = regs[0] >> 4;
+    uint8_t gain = (regs[0] & 0x01) ? 1 : 1 << ((regs[0] >> 1) & 0x07); //PGA bypass forces gain 1
+    float uV = 0;
+    if (mux == 0x0 || mux == 0x5)
+    {
+        //AIN0/AIN1 is thermocouple A, AIN2/AIN3 is thermocouple B
+        uint8_t zone = mux == 0x0 ? 0 : 1;
+        bool burnout = regs[1] & 0x01;
+        if (sim::faults.tc_open[zone])
+        {
+            //a broken thermocouple leaves both inputs at the 2.5V bias: reads 0V,
+            //unless the burnout sources pull them to the rails
+            uV = burnout ? 5e6 : 0;
+        }
+        else if (sim::faults.tc_short[zone])
+        {
+            //junction moved to the feedthrough, at the cold junction temperature:
+            //the burnout current only sees the board's resistors
+            uV = burnout ? ADS_BURNOUT_UA * SERIES_OHMS : 0;
+        }
+        else
+        {
+            uV = sim::type_t_uV(sim::plant_zone_temp(zone)) - sim::type_t_uV(sim::plant_cj_temp());
+            uV += burnout ? ADS_BURNOUT_UA * (SERIES_OHMS + TC_LOOP_OHMS) : 0;
+        }
+    }
+    double code = uV * 1e-6 / (2.0 * ADS_VREF / gain) * 65536.0;
+    if (code > 32767.0)
+    {
+        code = 32767.0; //inputs beyond full scale saturate the output code
+    }
+    else if (code < -32768.0)
+    {
+        code = -32768.0;
+    }
+    return (int16_t)lround(code);
+}
+
+static bool hung()
+{
+    //SPI link broken: MISO floats high and nothing gets through
+    return sim::now_us() < sim::faults.adc_hang_until;
+}
+
+uint8_t sim::ads_transfer(uint8_t in)
+{
+    if (hung())
+    {
+        converting = data_ready = false;
+        dout.clear();
+        wreg_left = 0;
+        return 0xFF;
+    }
+    ads_drdy_low(); //latch a finished conversion
+    if (!dout.empty())
+    {
+        //data or register readback being clocked out, DIN is ignored
+        uint8_t out = dout.front();
+        dout.pop_front();
+        return out;
+    }
+    if (wreg_left)
+    {
+        regs[wreg_addr++ & 0x03] = in;
+        wreg_left--;
+        return 0xFF;
+    }
+    if (data_ready && (in == 0xFF || in == 0x00))
+    {
+        //direct read of the conversion result once DRDY has fallen
+        data_ready = false;
+        dout.push_back(result & 0xFF);
+        return result >> 8;
+    }
+    if ((in & 0xF0) == ADS_CMD_WREG)
+    {
+        wreg_addr = (in >> 2) & 0x03;
+        wreg_left = (in & 0x03) + 1;
+    }
+    else if ((in & 0xF0) == ADS_CMD_RREG)
+    {
+        uint8_t addr = (in >> 2) & 0x03;
+        for (uint8_t i = 0; i <= (in & 0x03); i++)
+        {
+            dout.push_back(regs[(addr + i) & 0x03]);
+        }
+    }
+    else if ((in & 0xF0) == ADS_CMD_RDATA)
+    {
+        data_ready = false;
+        dout.push_back(result >> 8);
+        dout.push_back(result & 0xFF);
+    }
+    else if ((in & 0xFE) == ADS_CMD_RESET)
+    {
+        ads_power_on();
+    }
+    else if ((in & 0xFE) == ADS_CMD_START)
+    {
+        converting = true;
+        data_ready = false;
+        ready_at_us = now_us() + conversion_time_us();
+    }
+    else if ((in & 0xFE) == ADS_CMD_POWERDOWN)
+    {
+        converting = false;
+    }
+    return 0xFF;
+}
+
+bool sim::ads_drdy_low()
+{
+    if (hung())
+    {
+        return false;
+    }
+    if (converting && now_us() >= ready_at_us)
+    {
+        converting = false;
+        result = sample();
+        data_ready = true;
+    }
+    return data_ready && dout.empty();
+}
+
+uint64_t sim::ads_ready_at_us()
+{
+    return converting && !hung() ? ready_at_us : UINT64_MAX;
+}
@@ -0,0 +1,164 @@
+//Command-to-actuation latency benchmark (program --bench N).
+//Alternately sends <SET> and <OFF> at random points of the control period,
+//running the firmware at virtual time with a fixed cost per pass through
+//loop(), and timestamps every stage from the command's '>' reaching the
+//UART to the first heater switch edge after it. The setpoint sits far above
+//what the heaters can reach, so both run flat out after <SET> and <OFF>
+//always has something to switch off.
+#include <Arduino.h>
+#include "sim.h"
+#include "trace.h"
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+
+void setup();
+void loop();
+
+#define CMD_SET 0
+#define CMD_OFF 1
+
+#define STAGE_RX_COMPLETE 0
+#define STAGE_PARSED 1
+#define STAGE_PID_RUN 2
+#define STAGE_HEATER_EDGE 3
+#define STAGES 4
+
+#define WINDOW_US 3000000 //time a command gets to reach the heaters (three periods)
+
+static const char *const stage_names[STAGES] = {"rx complete", "parsed", "pid run", "heater edge"};
+
+static bool measuring;
+static uint64_t uart_end_us;
+static uint64_t stage_us[STAGES];
+static bool stage_seen[STAGES];
+static std::vector<double> latency_ms[2][STAGES];
+
+void trace_point(uint8_t point)
+{
+    sim::trace_at(point, sim::now_us());
+}
+
+void sim::trace_at(uint8_t point, uint64_t t_us)
+{
+    if (!measuring)
+    {
+        return;
+    }
+    int8_t stage = -1;
+    switch (point)
+    {
+    case TRACE_UART_END:
+        if (!uart_end_us)
+        {
+            uart_end_us = t_us;
+        }
+        return;
+    case TRACE_RX_COMPLETE:
+        stage = STAGE_RX_COMPLETE;
+        break;
+    case TRACE_PARSED:
+        stage = STAGE_PARSED;
+        break;
+    case TRACE_PID_RUN:
+        stage = STAGE_PID_RUN;
+        break;
+    case TRACE_HEATER_EDGE:
+        stage = STAGE_HEATER_EDGE;
+        break;
+    }
+    //only the first of each after the command was taken in counts
+    if (stage < 0 || stage_seen[stage] || (stage > STAGE_PARSED && !stage_seen[STAGE_PARSED]))
+    {
+        return;
+    }
+    stage_seen[stage] = true;
+    stage_us[stage] = t_us;
+}
+
+static void run_until(uint64_t t_us, uint32_t loop_us)
+{
+    while (sim::now_us() < t_us)
+    {
+        loop();
+        sim::advance_us(loop_us);
+    }
+}
+
+static void send(const char *frame)
+{
+    sim::serial_inject(frame, strlen(frame));
+}
+
+static void measure(uint8_t cmd, const char *frame, uint32_t loop_us, std::mt19937 &rng)
+{
+    uart_end_us = 0;
+    for (uint8_t i = 0; i < STAGES; i++)
+    {
+        stage_seen[i] = false;
+    }
+    measuring = true;
+    //land the command anywhere inside a pass through loop(), not always on its edge
+    send(frame);
+    sim::advance_us(std::uniform_int_distribution<uint32_t>(0, loop_us - 1)(rng));
+    run_until(sim::now_us() + WINDOW_US, loop_us);
+    measuring = false;
+    for (uint8_t i = 0; i < STAGES; i++)
+    {
+        if (stage_seen[i] && uart_end_us)
+        {
+            latency_ms[cmd][i].push_back((stage_us[i] - uart_end_us) / 1000.0);
+        }
+    }
+}
+
+static double percentile(const std::vector<double> &sorted, double q)
+{
+    size_t i = (size_t)(q * sorted.size());
+    return sorted[i < sorted.size() ? i : sorted.size() - 1];
+}
+
+int sim::bench(unsigned commands, uint32_t loop_us)
+{
+    std::mt19937 rng(1); //same sequence every run, so results compare across builds
+    std::uniform_int_distribution<uint32_t> gap_us(500000, 2500000);
+
+    setup();
+    run_until(1500000, loop_us);
+    send("<PID,5.0,0.1,0.0>"); //gains from the EEPROM may be anything
+    run_until(now_us() + 1000000, loop_us);
+
+    for (unsigned i = 0; i < commands; i++)
+    {
+        run_until(now_us() + gap_us(rng), loop_us);
+        measure(CMD_SET, "<SET,100.0>", loop_us, rng);
+        run_until(now_us() + gap_us(rng), loop_us);
+        measure(CMD_OFF, "<OFF>", loop_us, rng);
+    }
+
+    printf("%u x <SET>, %u x <OFF>, loop() %uus per pass plus blocking serial output\n", commands, commands, loop_us);
+    printf("latency from the command's '>' reaching the UART, ms\n");
+    printf("%-18s %5s %8s %8s %8s %8s %8s\n", "", "n", "min", "p50", "p90", "p99", "max");
+    for (uint8_t cmd = 0; cmd < 2; cmd++)
+    {
+        for (uint8_t i = 0; i < STAGES; i++)
+        {
+            std::vector<double> &v = latency_ms[cmd][i];
+            if (v.empty())
+            {
+                continue;
+            }
+            std::sort(v.begin(), v.end());
+            printf("%s %-12s %5zu %8.2f %8.2f %8.2f %8.2f %8.2f\n", cmd == CMD_SET ? "<SET>" : "<OFF>", stage_names[i],
+                   v.size(), v.front(), percentile(v, 0.5), percentile(v, 0.9), percentile(v, 0.99), v.back());
+        }
+    }
+    //a command that never made it to the heaters is the number that matters most
+    unsigned lost = commands - latency_ms[CMD_OFF][STAGE_HEATER_EDGE].size();
+    if (lost)
+    {
+        printf("%u <OFF> without a heater edge within %ums\n", lost, WINDOW_US / 1000);
+    }
+    return lost ? 1 : 0;
+}
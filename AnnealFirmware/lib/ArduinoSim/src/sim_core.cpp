@@ -0,0 +1,520 @@
+//Arduino core stand-in: clock, pins, UART, SPI, EEPROM and watchdog
+#include <Arduino.h>
+#include <SPI.h>
+#include <EEPROM.h>
+#include <avr/wdt.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <deque>
+#include "sim.h"
+#include "pins.h"
+
+HardwareSerial Serial;
+SPIClass SPI;
+EEPROMClass EEPROM;
+
+sim::Faults sim::faults;
+
+//------------------------------------------------------------------ clock
+static uint64_t clock_origin_ns;
+static bool clock_virtual;
+static uint64_t virtual_us;
+
+static uint64_t monotonic_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void sim::clock_begin()
+{
+    clock_origin_ns = monotonic_ns();
+}
+
+uint64_t sim::now_us()
+{
+    if (clock_virtual)
+    {
+        return virtual_us;
+    }
+    return (monotonic_ns() - clock_origin_ns) / 1000;
+}
+
+void sim::clock_set_virtual()
+{
+    clock_virtual = true;
+    virtual_us = 0;
+}
+
+bool sim::clock_is_virtual()
+{
+    return clock_virtual;
+}
+
+void sim::advance_us(uint64_t us)
+{
+    virtual_us += us;
+}
+
+uint32_t millis()
+{
+    return (uint32_t)(sim::now_us() / 1000);
+}
+
+uint32_t micros()
+{
+    return (uint32_t)sim::now_us();
+}
+
+void delay(uint32_t ms)
+{
+    if (clock_virtual)
+    {
+        virtual_us += (uint64_t)ms * 1000;
+        return;
+    }
+    uint64_t until = sim::now_us() + (uint64_t)ms * 1000;
+    while (sim::now_us() < until)
+    {
+        sim::serial_poll();
+        usleep(100);
+    }
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    if (clock_virtual)
+    {
+        virtual_us += us;
+        return;
+    }
+    uint64_t until = sim::now_us() + us;
+    while (sim::now_us() < until)
+        ;
+}
+
+//------------------------------------------------------------------ pins
+static uint8_t pin_modes[20];
+static bool heater_on[2];
+
+static void drive_heater(uint8_t heater, bool on)
+{
+    if (on != heater_on[heater])
+    {
+        heater_on[heater] = on;
+        sim::trace_at(TRACE_HEATER_EDGE, sim::now_us());
+    }
+    sim::plant_set_heater(heater, on);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    pin_modes[pin] = mode;
+    if (mode != OUTPUT)
+    {
+        //tri-stated switch line: nothing drives the MOSFET gate in the simulation
+        if (pin == HT_A_SW)
+        {
+            drive_heater(0, false);
+        }
+        else if (pin == HT_B_SW)
+        {
+            drive_heater(1, false);
+        }
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    if (pin_modes[pin] != OUTPUT)
+    {
+        return;
+    }
+    if (pin == HT_A_SW)
+    {
+        drive_heater(0, val);
+    }
+    else if (pin == HT_B_SW)
+    {
+        drive_heater(1, val);
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    switch (pin)
+    {
+    case ADC_MISO_DRDY:
+        return sim::ads_drdy_low() ? LOW : HIGH;
+    case MANUAL_SW:
+        return HIGH; //switch in the CPU position
+    case HT_A_SNS:
+        return sim::faults.fuse_blown[0] ? LOW : HIGH;
+    case HT_B_SNS:
+        return sim::faults.fuse_blown[1] ? LOW : HIGH;
+    default:
+        return LOW;
+    }
+}
+
+//------------------------------------------------------------------ interrupts
+uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+
+//the firmware's handlers replace these
+__attribute__((weak)) void PCINT0_vect() {}
+__attribute__((weak)) void PCINT1_vect() {}
+__attribute__((weak)) void PCINT2_vect() {}
+
+//raises the pin-change interrupt of every group with an enabled pin whose
+//level changed since the last look; true if any was raised
+static bool pin_change_interrupts()
+{
+    static int8_t levels[20]; //0 before the first look at a pin
+    static void (*const vectors[3])() = {PCINT0_vect, PCINT1_vect, PCINT2_vect};
+    bool raised[3] = {false, false, false};
+    for (uint8_t pin = 0; pin < 20; pin++)
+    {
+        uint8_t group = digitalPinToPCICRbit(pin);
+        int8_t level = digitalRead(pin) ? 1 : -1;
+        if ((PCICR & _BV(group)) && (*digitalPinToPCMSK(pin) & _BV(digitalPinToPCMSKbit(pin))) &&
+            levels[pin] && levels[pin] != level)
+        {
+            raised[group] = true;
+        }
+        levels[pin] = level;
+    }
+    for (uint8_t group = 0; group < 3; group++)
+    {
+        if (raised[group])
+        {
+            vectors[group]();
+        }
+    }
+    return raised[0] || raised[1] || raised[2];
+}
+
+//------------------------------------------------------------------ Print
+size_t Print::write(const char *str)
+{
+    size_t n = 0;
+    while (*str)
+    {
+        n += write((uint8_t)*str++);
+    }
+    return n;
+}
+
+size_t Print::print(const __FlashStringHelper *str) { return write(reinterpret_cast<const char *>(str)); }
+size_t Print::print(const char *str) { return write(str); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(unsigned char n, int base) { return print((unsigned long)n, base); }
+size_t Print::print(int n, int base) { return print((long)n, base); }
+size_t Print::print(unsigned int n, int base) { return print((unsigned long)n, base); }
+
+size_t Print::print(long n, int base)
+{
+    //AVR longs are 32 bits wide
+    int32_t v = (int32_t)n;
+    if (base == DEC && v < 0)
+    {
+        return print('-') + print_number((uint32_t)(-(int64_t)v), DEC);
+    }
+    return print_number((uint32_t)v, base);
+}
+
+size_t Print::print(unsigned long n, int base) { return print_number((uint32_t)n, base); }
+size_t Print::print(double n, int digits) { return print_float((float)n, digits); }
+
+size_t Print::println() { return write('\r') + write('\n'); }
+size_t Print::println(const __FlashStringHelper *str) { return print(str) + println(); }
+size_t Print::println(const char *str) { return print(str) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(unsigned char n, int base) { return print(n, base) + println(); }
+size_t Print::println(int n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base) { return print(n, base) + println(); }
+size_t Print::println(long n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base) { return print(n, base) + println(); }
+size_t Print::println(double n, int digits) { return print(n, digits) + println(); }
+
+size_t Print::print_number(unsigned long n, uint8_t base)
+{
+    char buf[8 * sizeof(long) + 1];
+    char *str = &buf[sizeof(buf) - 1];
+    *str = '\0';
+    if (base < 2)
+    {
+        base = 10;
+    }
+    do
+    {
+        char c = n % base;
+        n /= base;
+        *--str = c < 10 ? c + '0' : c + 'A' - 10;
+    } while (n);
+    return write(str);
+}
+
+size_t Print::print_float(float number, uint8_t digits)
+{
+    //same algorithm (and single-precision rounding) as Print::printFloat on AVR
+    if (isnan(number))
+        return print("nan");
+    if (isinf(number))
+        return print("inf");
+    if (number > 4294967040.0f || number < -4294967040.0f)
+        return print("ovf");
+
+    size_t n = 0;
+    if (number < 0.0f)
+    {
+        n += print('-');
+        number = -number;
+    }
+    float rounding = 0.5f;
+    for (uint8_t i = 0; i < digits; ++i)
+        rounding /= 10.0f;
+    number += rounding;
+
+    unsigned long int_part = (uint32_t)number;
+    float remainder = number - (float)int_part;
+    n += print(int_part);
+    if (digits > 0)
+        n += print('.');
+    while (digits-- > 0)
+    {
+        remainder *= 10.0f;
+        unsigned int to_print = (unsigned int)remainder;
+        n += print(to_print);
+        remainder -= to_print;
+    }
+    return n;
+}
+
+//------------------------------------------------------------------ UART
+#define SERIAL_RX_BUFFER_SIZE 64
+#define SERIAL_TX_BUFFER_SIZE 64
+#define UART_BYTE_US 40 //10 bits per byte at 250kbit/s
+
+static int uart_rx_fd = -1, uart_tx_fd = -1;
+static std::deque<uint8_t> wire;  //bytes sent by the host, not yet clocked in
+static uint64_t wire_next_us;     //arrival time of the byte at the head of the wire
+static uint8_t rx_ring[SERIAL_RX_BUFFER_SIZE];
+static uint8_t rx_head, rx_tail;
+static uint64_t tx_idle_at_us; //when the last queued byte will have left the UART
+static void (*tx_hook)(uint8_t c);
+
+void sim::serial_attach(int rx_fd, int tx_fd)
+{
+    uart_rx_fd = rx_fd;
+    uart_tx_fd = tx_fd;
+}
+
+void sim::serial_poll()
+{
+    uint64_t now = now_us();
+    if (uart_rx_fd >= 0)
+    {
+        uint8_t buf[256];
+        ssize_t len = read(uart_rx_fd, buf, sizeof(buf));
+        if (len > 0)
+        {
+            if (wire.empty())
+            {
+                wire_next_us = now + UART_BYTE_US;
+            }
+            wire.insert(wire.end(), buf, buf + len);
+        }
+    }
+    //clock bytes into the receive ring at the line rate
+    while (!wire.empty() && wire_next_us <= now)
+    {
+        uint8_t next = (rx_head + 1) % SERIAL_RX_BUFFER_SIZE;
+        if (next != rx_tail) //a full ring drops the byte, like the AVR core's RX ISR
+        {
+            rx_ring[rx_head] = wire.front();
+            rx_head = next;
+            if (wire.front() == '>')
+            {
+                trace_at(TRACE_UART_END, wire_next_us);
+            }
+        }
+        wire.pop_front();
+        wire_next_us += UART_BYTE_US;
+    }
+}
+
+void sim::serial_inject(const char *data, size_t len)
+{
+    if (wire.empty())
+    {
+        wire_next_us = now_us() + UART_BYTE_US;
+    }
+    wire.insert(wire.end(), data, data + len);
+}
+
+void sim::serial_set_tx_hook(void (*hook)(uint8_t c))
+{
+    tx_hook = hook;
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+    (void)baud;
+}
+
+int HardwareSerial::available()
+{
+    sim::serial_poll();
+    return ((unsigned int)(SERIAL_RX_BUFFER_SIZE + rx_head - rx_tail)) % SERIAL_RX_BUFFER_SIZE;
+}
+
+int HardwareSerial::read()
+{
+    if (rx_head == rx_tail)
+    {
+        return -1;
+    }
+    uint8_t c = rx_ring[rx_tail];
+    rx_tail = (rx_tail + 1) % SERIAL_RX_BUFFER_SIZE;
+    return c;
+}
+
+void HardwareSerial::flush()
+{
+    if (clock_virtual && tx_idle_at_us > virtual_us)
+    {
+        virtual_us = tx_idle_at_us;
+        sim::serial_poll();
+    }
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    if (clock_virtual)
+    {
+        //once the 64 byte TX ring is full, write() blocks until the UART frees a slot
+        uint64_t now = virtual_us;
+        if (tx_idle_at_us < now)
+        {
+            tx_idle_at_us = now;
+        }
+        uint64_t full_until = tx_idle_at_us - SERIAL_TX_BUFFER_SIZE * UART_BYTE_US;
+        if (tx_idle_at_us > SERIAL_TX_BUFFER_SIZE * UART_BYTE_US && full_until > now)
+        {
+            virtual_us = full_until;
+            sim::serial_poll(); //the RX interrupt keeps running meanwhile
+        }
+        tx_idle_at_us += UART_BYTE_US;
+    }
+    if (tx_hook)
+    {
+        tx_hook(c);
+    }
+    //nobody listening on the other end of the line: the byte is lost, as on a real UART
+    if (uart_tx_fd >= 0 && ::write(uart_tx_fd, &c, 1) != 1 && errno != EAGAIN)
+    {
+        uart_tx_fd = -1;
+    }
+    return 1;
+}
+
+//------------------------------------------------------------------ sleep
+void sim_sleep_cpu()
+{
+    //a pin that changed while the firmware was busy interrupts right away
+    if (pin_change_interrupts())
+    {
+        return;
+    }
+    if (clock_virtual)
+    {
+        //skip to whatever wakes the MCU first: the next Timer0 tick, the
+        //next byte off the wire or the ADC finishing a conversion
+        uint64_t wake = (virtual_us / 1000 + 1) * 1000;
+        if (!wire.empty())
+        {
+            wake = min(wake, wire_next_us);
+        }
+        wake = min(wake, sim::ads_ready_at_us());
+        virtual_us = max(virtual_us, wake);
+    }
+    else
+    {
+        usleep(50); //wake often enough to see host bytes as they arrive
+    }
+    sim::serial_poll();
+    pin_change_interrupts();
+}
+
+//------------------------------------------------------------------ SPI
+void SPIClass::begin() {}
+void SPIClass::end() {}
+void SPIClass::setDataMode(uint8_t mode) { (void)mode; }
+void SPIClass::beginTransaction(SPISettings settings) { (void)settings; }
+void SPIClass::endTransaction() {}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+    return sim::ads_transfer(data);
+}
+
+//------------------------------------------------------------------ EEPROM
+static uint8_t eeprom[SIM_EEPROM_SIZE];
+static FILE *eeprom_file;
+static bool eeprom_loaded;
+
+bool sim_eeprom_open(const char *path)
+{
+    memset(eeprom, 0xFF, sizeof(eeprom));
+    eeprom_loaded = true;
+    if (!path)
+    {
+        return true;
+    }
+    eeprom_file = fopen(path, "r+b");
+    if (!eeprom_file)
+    {
+        eeprom_file = fopen(path, "w+b");
+        if (!eeprom_file)
+        {
+            return false;
+        }
+        fwrite(eeprom, 1, sizeof(eeprom), eeprom_file);
+        fflush(eeprom_file);
+    }
+    else if (fread(eeprom, 1, sizeof(eeprom), eeprom_file) != sizeof(eeprom))
+    {
+        //short file: the rest stays erased
+    }
+    return true;
+}
+
+uint8_t *sim_eeprom_data()
+{
+    if (!eeprom_loaded)
+    {
+        sim_eeprom_open(nullptr);
+    }
+    return eeprom;
+}
+
+void sim_eeprom_commit(int idx, int len)
+{
+    if (eeprom_file)
+    {
+        fseek(eeprom_file, idx, SEEK_SET);
+        fwrite(eeprom + idx, 1, len, eeprom_file);
+        fflush(eeprom_file);
+    }
+}
+
+//------------------------------------------------------------------ watchdog
+void wdt_enable(unsigned char timeout)
+{
+    (void)timeout;
+    sim::reset();
+}
@@ -0,0 +1,274 @@
+//Entry point of the native firmware build: wires up the simulated box, then
+//runs setup()/loop() like the Arduino core does
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "sim.h"
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <stdio.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+
+void setup();
+void loop();
+
+static std::vector<char *> saved_argv;
+static int pty_master = -1, pty_slave = -1;
+static const char *pty_link;
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --pty            serve the UART on a new pseudo-terminal (default)\n"
+            "  --link PATH      symlink PATH to the pseudo-terminal\n"
+            "  --stdio          serve the UART on stdin/stdout instead\n"
+            "  --plant FILE     thermal model parameters (key = value)\n"
+            "  --eeprom FILE    back the EEPROM with FILE so it survives restarts\n"
+            "  --replay FILE    replay a session recorded by anneal-gateway -r at virtual time\n"
+            "                   and compare the telemetry; exits 0 if it matches, 1 if not\n"
+            "  --bench N        time N <SET> and N <OFF> commands from the UART to the heaters\n"
+            "  --loop-us N      virtual time one pass through loop() takes (default 100)\n"
+            "  --verbose        print the replayed traffic\n",
+            prog);
+}
+
+static void on_terminate(int sig)
+{
+    (void)sig;
+    if (pty_link)
+    {
+        unlink(pty_link); //don't leave clients a link to a dead terminal
+    }
+    _exit(0);
+}
+
+static bool open_pty(const char *link)
+{
+    pty_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (pty_master < 0 || grantpt(pty_master) || unlockpt(pty_master))
+    {
+        perror("posix_openpt");
+        return false;
+    }
+    const char *name = ptsname(pty_master);
+    //hold the slave open so reads on the master don't fail while no client
+    //is attached, and put it in raw mode like a USB serial adaptor
+    pty_slave = open(name, O_RDWR | O_NOCTTY);
+    if (pty_slave < 0)
+    {
+        perror(name);
+        return false;
+    }
+    termios tio;
+    tcgetattr(pty_slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(pty_slave, TCSANOW, &tio);
+    fcntl(pty_master, F_SETFL, O_NONBLOCK);
+
+    fprintf(stderr, "anneal-sim: UART on %s\n", name);
+    if (link)
+    {
+        unlink(link);
+        if (symlink(name, link))
+        {
+            perror(link);
+            return false;
+        }
+    }
+    return true;
+}
+
+void sim::reset()
+{
+    //a watchdog reset clears all of RAM: start over as a fresh process,
+    //passing the open pseudo-terminal along so clients stay connected
+    std::vector<char *> args(saved_argv);
+    char inherit[32];
+    if (pty_master >= 0)
+    {
+        snprintf(inherit, sizeof(inherit), "--inherit-pty=%d,%d", pty_master, pty_slave);
+        args.push_back(inherit);
+    }
+    std::vector<std::string> resume;
+    if (sim::replaying())
+    {
+        resume = sim::replay_next_segment();
+        for (std::string &arg : resume)
+        {
+            args.push_back(&arg[0]);
+        }
+    }
+    args.push_back(nullptr);
+    fflush(stdout);
+    //exec the resolved path so the process keeps its name for pgrep/pkill
+    char self[4096];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    self[len > 0 ? len : 0] = '\0';
+    execv(len > 0 ? self : "/proc/self/exe", args.data());
+    perror("execv");
+    _exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    enum
+    {
+        OPT_PTY = 256,
+        OPT_LINK,
+        OPT_STDIO,
+        OPT_PLANT,
+        OPT_EEPROM,
+        OPT_REPLAY,
+        OPT_BENCH,
+        OPT_LOOP_US,
+        OPT_VERBOSE,
+        OPT_INHERIT_PTY,
+        OPT_REPLAY_RESUME,
+    };
+    static const option options[] = {
+        {"pty", no_argument, nullptr, OPT_PTY},
+        {"link", required_argument, nullptr, OPT_LINK},
+        {"stdio", no_argument, nullptr, OPT_STDIO},
+        {"plant", required_argument, nullptr, OPT_PLANT},
+        {"eeprom", required_argument, nullptr, OPT_EEPROM},
+        {"replay", required_argument, nullptr, OPT_REPLAY},
+        {"bench", required_argument, nullptr, OPT_BENCH},
+        {"loop-us", required_argument, nullptr, OPT_LOOP_US},
+        {"verbose", no_argument, nullptr, OPT_VERBOSE},
+        {"inherit-pty", required_argument, nullptr, OPT_INHERIT_PTY},
+        {"replay-resume", required_argument, nullptr, OPT_REPLAY_RESUME},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    const char *eeprom_path = nullptr;
+    bool use_stdio = false, inherited = false;
+    sim::PlantParams plant;
+    std::string err;
+    sim::ReplayOptions replay = {};
+    replay.loop_us = 100;
+    unsigned bench = 0;
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--inherit-pty", 13) != 0 && strncmp(argv[i], "--replay-resume", 15) != 0)
+        {
+            saved_argv.push_back(argv[i]);
+        }
+    }
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", options, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case OPT_PTY:
+            use_stdio = false;
+            break;
+        case OPT_LINK:
+            pty_link = optarg;
+            break;
+        case OPT_STDIO:
+            use_stdio = true;
+            break;
+        case OPT_PLANT:
+            if (!sim::load_plant_params(optarg, plant, err))
+            {
+                fprintf(stderr, "%s\n", err.c_str());
+                return 1;
+            }
+            break;
+        case OPT_EEPROM:
+            eeprom_path = optarg;
+            break;
+        case OPT_REPLAY:
+            replay.path = optarg;
+            break;
+        case OPT_BENCH:
+            bench = strtoul(optarg, nullptr, 10);
+            if (!bench)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case OPT_LOOP_US:
+            replay.loop_us = strtoul(optarg, nullptr, 10);
+            if (!replay.loop_us)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case OPT_VERBOSE:
+            replay.verbose = true;
+            break;
+        case OPT_REPLAY_RESUME:
+            if (sscanf(optarg, "%u,%u", &replay.segment, &replay.mismatches) != 2)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case OPT_INHERIT_PTY:
+            if (sscanf(optarg, "%d,%d", &pty_master, &pty_slave) != 2)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            inherited = true; //link already in place
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (!sim_eeprom_open(eeprom_path))
+    {
+        perror(eeprom_path);
+        return 1;
+    }
+    if (bench || replay.path)
+    {
+        sim::clock_set_virtual();
+        sim::plant_begin(plant);
+        sim::ads_power_on();
+        if (bench)
+        {
+            return sim::bench(bench, replay.loop_us);
+        }
+        //the recording stands in for the host and the thermocouples
+        replay.seed_gains = !eeprom_path;
+        return sim::replay(replay);
+    }
+    if (use_stdio)
+    {
+        fcntl(STDIN_FILENO, F_SETFL, O_NONBLOCK);
+        sim::serial_attach(STDIN_FILENO, STDOUT_FILENO);
+    }
+    else
+    {
+        if (!inherited && !open_pty(pty_link))
+        {
+            return 1;
+        }
+        signal(SIGINT, on_terminate);
+        signal(SIGTERM, on_terminate);
+        sim::serial_attach(pty_master, pty_master);
+    }
+
+    sim::clock_begin();
+    sim::plant_begin(plant);
+    sim::ads_power_on();
+
+    setup();
+    for (;;)
+    {
+        loop(); //sleeps in sleep_cpu() between events, like the MCU
+    }
+}
@@ -0,0 +1,232 @@
+//Two-zone thermal model of the target holder and the type T thermocouples on it
+#include "sim.h"
+#include <math.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define PLANT_STEP_US 10000 //integration step, 10ms
+
+static sim::PlantParams plant;
+static float zone_temp[2];
+static bool heater_on[2];
+static uint64_t plant_time_us;
+//heater state history, one entry per step, to delay the heat reaching the thermocouples
+static std::vector<uint8_t> history[2];
+static size_t history_pos;
+static std::vector<sim::PlantSample> follow;
+static size_t follow_pos;
+
+bool sim::load_plant_params(const char *path, PlantParams &params, std::string &err)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        err = std::string(path) + ": " + strerror(errno);
+        return false;
+    }
+    char line[256];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        lineno++;
+        char key[32];
+        float value;
+        char *hash = strchr(line, '#');
+        if (hash)
+        {
+            *hash = '\0';
+        }
+        if (sscanf(line, " %31[A-Za-z0-9_] = %f", key, &value) != 2)
+        {
+            if (strspn(line, " \t\r\n") != strlen(line))
+            {
+                err = std::string(path) + ":" + std::to_string(lineno) + ": expected key = value";
+                fclose(f);
+                return false;
+            }
+            continue;
+        }
+        static const char *zones = "AB";
+        bool known = true;
+        if (!strcmp(key, "T_cj"))
+        {
+            params.T_cj = value;
+        }
+        else if (strlen(key) == 5 && !strncmp(key, "tau_", 4) && strchr(zones, key[4]))
+        {
+            params.tau[key[4] - 'A'] = value;
+        }
+        else if (strlen(key) == 6 && !strncmp(key, "dead_", 5) && strchr(zones, key[5]))
+        {
+            params.dead[key[5] - 'A'] = value;
+        }
+        else if (strlen(key) == 4 && !strncmp(key, "T0_", 3) && strchr(zones, key[3]))
+        {
+            params.T0[key[3] - 'A'] = value;
+        }
+        else if (strlen(key) == 4 && key[0] == 'K' && key[1] == '_' && strchr(zones, key[2]) && strchr(zones, key[3]))
+        {
+            params.K[key[2] - 'A'][key[3] - 'A'] = value;
+        }
+        else
+        {
+            known = false;
+        }
+        if (!known)
+        {
+            //model files from the identification tool carry extra fit statistics
+            fprintf(stderr, "%s:%d: ignoring unknown key %s\n", path, lineno, key);
+        }
+    }
+    fclose(f);
+    if (params.tau[0] <= 0 || params.tau[1] <= 0 || params.dead[0] < 0 || params.dead[1] < 0)
+    {
+        err = std::string(path) + ": time constants must be positive and dead times non-negative";
+        return false;
+    }
+    return true;
+}
+
+void sim::plant_begin(const PlantParams &params)
+{
+    plant = params;
+    for (uint8_t z = 0; z < 2; z++)
+    {
+        zone_temp[z] = plant.T0[z];
+        heater_on[z] = false;
+        size_t len = (size_t)(plant.dead[z] * 1e6 / PLANT_STEP_US) + 1;
+        history[z].assign(len, 0);
+    }
+    history_pos = 0;
+    plant_time_us = now_us();
+}
+
+static void plant_advance()
+{
+    uint64_t now = sim::now_us();
+    while (plant_time_us + PLANT_STEP_US <= now)
+    {
+        float u[2];
+        for (uint8_t h = 0; h < 2; h++)
+        {
+            std::vector<uint8_t> &hist = history[h];
+            hist[history_pos % hist.size()] = heater_on[h];
+            //oldest entry in the ring is the heater state one dead time ago
+            u[h] = hist[(history_pos + 1) % hist.size()] ? 100.0 : 0.0;
+        }
+        for (uint8_t z = 0; z < 2; z++)
+        {
+            float target = plant.T0[z] + plant.K[z][0] * u[0] + plant.K[z][1] * u[1];
+            zone_temp[z] += (target - zone_temp[z]) * (PLANT_STEP_US / 1e6) / plant.tau[z];
+        }
+        history_pos++;
+        plant_time_us += PLANT_STEP_US;
+    }
+}
+
+void sim::plant_set_heater(uint8_t heater, bool on)
+{
+    if (heater_on[heater] != on)
+    {
+        plant_advance(); //the old state held up to now
+        heater_on[heater] = on;
+    }
+}
+
+//the NIST inverse fits a controller turns microvolts into degC with; below
+//-200degC they drift several degrees away from the reference function
+static double type_t_inverse_fit(double uV)
+{
+    static const double neg[] = {0.0, 2.5949192E-02, -2.1316967E-07, 7.9018692E-10, 4.2527777E-13,
+                                 1.3304473E-16, 2.0241446E-20, 1.2668171E-24};
+    static const double pos[] = {0.0, 2.592800E-02, -7.602961E-07, 4.637791E-11, -2.165394E-15,
+                                 6.048144E-20, -7.293422E-25};
+    const double *c = uV <= 0 ? neg : pos;
+    int n = uV <= 0 ? sizeof(neg) / sizeof(double) : sizeof(pos) / sizeof(double);
+    double t = 0;
+    for (int i = n - 1; i >= 0; i--)
+    {
+        t = t * uV + c[i];
+    }
+    return t;
+}
+
+//the temperature a controller reports as `reported`
+static float as_measured(float reported)
+{
+    float lo = -270.0, hi = 400.0;
+    for (uint8_t i = 0; i < 40; i++)
+    {
+        float mid = (lo + hi) / 2;
+        (type_t_inverse_fit(sim::type_t_uV(mid)) < reported ? lo : hi) = mid;
+    }
+    return (lo + hi) / 2;
+}
+
+void sim::plant_follow(const std::vector<PlantSample> &samples)
+{
+    //the samples are what the controller read, so the zones sit wherever
+    //the controller's conversion would have put them there
+    follow = samples;
+    for (PlantSample &s : follow)
+    {
+        s.zone[0] = as_measured(s.zone[0]);
+        s.zone[1] = as_measured(s.zone[1]);
+    }
+    follow_pos = 0;
+}
+
+//recorded sample in effect at now; the first one also covers the time before it
+static const sim::PlantSample &followed()
+{
+    uint64_t now = sim::now_us();
+    while (follow_pos + 1 < follow.size() && follow[follow_pos + 1].t_us <= now)
+    {
+        follow_pos++;
+    }
+    return follow[follow_pos];
+}
+
+float sim::plant_zone_temp(uint8_t zone)
+{
+    if (!follow.empty())
+    {
+        return followed().zone[zone];
+    }
+    plant_advance();
+    return zone_temp[zone];
+}
+
+float sim::plant_cj_temp()
+{
+    if (!follow.empty())
+    {
+        return followed().cj;
+    }
+    return plant.T_cj;
+}
+
+//ITS-90 type T reference function coefficients (NIST monograph 175)
+static const double TYPE_T_NEG[] = {
+    0.0, 3.8748106364E+01, 4.4194434347E-02, 1.1844323105E-04, 2.0032973554E-05,
+    9.0138019559E-07, 2.2651156593E-08, 3.6071154205E-10, 3.8493939883E-12,
+    2.8213521925E-14, 1.4251594779E-16, 4.8768662286E-19, 1.0795539270E-21,
+    1.3945027062E-24, 7.9795153927E-28}; //-270 to 0degC
+static const double TYPE_T_POS[] = {
+    0.0, 3.8748106364E+01, 3.3292227880E-02, 2.0618243404E-04, -2.1882256846E-06,
+    1.0996880928E-08, -3.0815758772E-11, 4.5479135290E-14, -2.7512901673E-17}; //0 to 400degC
+
+float sim::type_t_uV(float temp)
+{
+    const double *c = temp < 0 ? TYPE_T_NEG : TYPE_T_POS;
+    int n = temp < 0 ? sizeof(TYPE_T_NEG) / sizeof(double) : sizeof(TYPE_T_POS) / sizeof(double);
+    double t = temp < -270.0 ? -270.0 : temp; //the thermocouple has nothing left to give below -270degC
+    double uV = 0;
+    for (int i = n - 1; i >= 0; i--)
+    {
+        uV = uV * t + c[i];
+    }
+    return (float)uV;
+}
@@ -0,0 +1,473 @@
+//Replays a serial session recorded by anneal-gateway -r against the firmware.
+//Each line of a recording is
+//  MS > <CMD,...>      command the host sent
+//  MS < text           line the controller printed
+//  MS ! fault args     hardware fault to inject (added by hand):
+//                        adc_hang MS, tc_open A|B 0|1, tc_short A|B 0|1,
+//                        fuse_blown A|B 0|1
+//with MS the host's clock in milliseconds. The recording is cut into boots at
+//each "boot" line. For a boot, device time 0 is placed where the <DAT> uptimes
+//say the controller started, the host commands and faults are fed in at
+//their device times, the thermocouples follow the recorded temperatures, and
+//the firmware runs at virtual time. Afterwards the <DAT>/<ERR> packets it sent
+//are lined up with the recorded ones by uptime and compared.
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "sim.h"
+#include "storage.h"
+#include "protocol.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void setup();
+void loop();
+extern const uint16_t LOOP_PERIOD;
+
+#define DAT_FIELDS PROTO_DAT_FIELDS //the last ones are missing from older firmware
+#define DAT_MIN_FIELDS PROTO_DAT_MIN_FIELDS
+#define UPTIME_TOL 0.5  //s; the two clocks drift apart by a loop() or so per period
+#define MAX_REPORTED 50 //differences printed per boot
+
+struct Event
+{
+    uint64_t host_ms;
+    char dir; //'>', '<' or '!'
+    std::string text;
+};
+
+//one telemetry period: a <DAT> and the <ERR> that follows it, if any
+struct Period
+{
+    float dat[DAT_FIELDS];
+    uint8_t fields;
+    std::string err;
+};
+
+static const char *const dat_names[DAT_FIELDS] = {
+#define DAT_NAME(name, decimals) #name,
+    PROTOCOL_DAT_FIELDS(DAT_NAME)
+#undef DAT_NAME
+};
+//allowed difference per field: the temperatures pass through the ADC again
+//and come back within a few LSBs, the duties follow from them
+static const float dat_tol[] = {UPTIME_TOL, 0, 0.1, 0.1, 0.04, 1, 1, 0, 0, 0, 0};
+static_assert(sizeof(dat_tol) / sizeof(float) == DAT_FIELDS, "a tolerance for every <DAT> field");
+
+static sim::ReplayOptions opts;
+static bool active;
+static std::vector<Event> events;     //whole recording
+static size_t seg_begin, seg_end;     //this boot's slice of events
+static size_t boots;                  //boots in the recording
+static int64_t offset_ms;             //host clock at device time 0
+static float record_end_s;            //device time of this boot's last recorded line
+static std::vector<Period> recorded, replayed;
+static std::string tx_line;
+static int resume_at = -1; //boot to continue with once this one is wrapped up
+
+//number of fields, 0 if the line isn't a <DAT>
+static uint8_t parse_dat(const std::string &line, float *v)
+{
+    if (line.compare(0, 5, "<DAT,") != 0 || line.back() != '>')
+    {
+        return 0;
+    }
+    const char *p = line.c_str() + 5;
+    for (uint8_t i = 0; i < DAT_FIELDS; i++)
+    {
+        char *end;
+        v[i] = strtof(p, &end);
+        if (end == p || (*end != ',' && *end != '>'))
+        {
+            return 0;
+        }
+        if (*end == '>')
+        {
+            return i + 1 >= DAT_MIN_FIELDS ? i + 1 : 0;
+        }
+        p = end + 1;
+    }
+    return DAT_FIELDS; //fields this doesn't know about yet are ignored
+}
+
+//adds a controller line to a list of periods
+static void collect(const std::string &line, std::vector<Period> &periods)
+{
+    Period p;
+    p.fields = parse_dat(line, p.dat);
+    if (p.fields)
+    {
+        periods.push_back(p);
+    }
+    else if (line.compare(0, 5, "<ERR,") == 0 && !periods.empty())
+    {
+        periods.back().err = line;
+    }
+}
+
+static void on_tx(uint8_t c)
+{
+    if (c == '\r')
+    {
+        return;
+    }
+    if (c != '\n')
+    {
+        tx_line += (char)c;
+        return;
+    }
+    if (opts.verbose)
+    {
+        printf("%10.3f < %s\n", sim::now_us() / 1e6, tx_line.c_str());
+    }
+    collect(tx_line, replayed);
+    tx_line.clear();
+}
+
+static bool load(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        perror(path);
+        return false;
+    }
+    char buf[512];
+    unsigned lineno = 0;
+    while (fgets(buf, sizeof(buf), f))
+    {
+        lineno++;
+        buf[strcspn(buf, "\r\n")] = '\0';
+        unsigned long long ms;
+        char dir;
+        int text;
+        if (buf[0] == '\0' || buf[0] == '#')
+        {
+            continue;
+        }
+        if (sscanf(buf, "%llu %c %n", &ms, &dir, &text) < 2 || !strchr("<>!", dir))
+        {
+            fprintf(stderr, "%s:%u: expected \"MS <|>|! text\"\n", path, lineno);
+            fclose(f);
+            return false;
+        }
+        events.push_back({ms, dir, buf + text});
+    }
+    fclose(f);
+    return true;
+}
+
+static bool is_boot(const Event &e)
+{
+    return e.dir == '<' && e.text == "boot";
+}
+
+//applies a '!' line; returns false if it can't be understood
+static bool apply_fault(const std::string &text, bool at_boot)
+{
+    char what[16], ch;
+    unsigned long arg;
+    if (sscanf(text.c_str(), "adc_hang %lu", &arg) == 1)
+    {
+        if (!at_boot) //a hang doesn't outlive the power cycle
+        {
+            sim::faults.adc_hang_until = sim::now_us() + (uint64_t)arg * 1000;
+        }
+        return true;
+    }
+    if (sscanf(text.c_str(), "%15s %c %lu", what, &ch, &arg) == 3 && (ch == 'A' || ch == 'B'))
+    {
+        uint8_t i = ch == 'A' ? 0 : 1;
+        if (!strcmp(what, "tc_open"))
+        {
+            sim::faults.tc_open[i] = arg;
+            return true;
+        }
+        if (!strcmp(what, "tc_short"))
+        {
+            sim::faults.tc_short[i] = arg;
+            return true;
+        }
+        if (!strcmp(what, "fuse_blown"))
+        {
+            sim::faults.fuse_blown[i] = arg;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int64_t device_ms(const Event &e)
+{
+    return (int64_t)e.host_ms - offset_ms;
+}
+
+static void report(unsigned &shown, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void report(unsigned &shown, const char *fmt, ...)
+{
+    if (shown++ == MAX_REPORTED)
+    {
+        printf("  ...\n");
+    }
+    if (shown > MAX_REPORTED)
+    {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    printf("  ");
+    vprintf(fmt, ap);
+    printf("\n");
+    va_end(ap);
+}
+
+static bool same(float a, float b, float tol)
+{
+    if (isnan(a) || isnan(b))
+    {
+        return isnan(a) && isnan(b);
+    }
+    return fabsf(a - b) <= tol + 0.005f; //both sides were printed to two decimals
+}
+
+//compares the periods replayed so far with the recorded ones; a period the
+//firmware had no time to produce before stop_s is not counted as missing,
+//nor one it produced after the recording ends
+static unsigned compare(float stop_s)
+{
+    unsigned diffs = 0, shown = 0;
+    size_t r = 0, p = 0;
+    while (r < recorded.size() || p < replayed.size())
+    {
+        const Period *rec = r < recorded.size() ? &recorded[r] : nullptr;
+        const Period *rep = p < replayed.size() ? &replayed[p] : nullptr;
+        if (rec && rep && same(rec->dat[0], rep->dat[0], UPTIME_TOL))
+        {
+            //a field only one side has is a protocol change, not a difference
+            uint8_t fields = min(rec->fields, rep->fields);
+            for (uint8_t i = 1; i < fields; i++)
+            {
+                if (!same(rec->dat[i], rep->dat[i], dat_tol[i]))
+                {
+                    diffs++;
+                    report(shown, "%8.2fs %s: recorded %.5g, replayed %.5g", rec->dat[0], dat_names[i], rec->dat[i],
+                           rep->dat[i]);
+                }
+            }
+            if (rec->err != rep->err)
+            {
+                diffs++;
+                report(shown, "%8.2fs recorded %s, replayed %s", rec->dat[0],
+                       rec->err.empty() ? "no <ERR>" : rec->err.c_str(), rep->err.empty() ? "no <ERR>" : rep->err.c_str());
+            }
+            r++;
+            p++;
+        }
+        else if (rec && (!rep || rec->dat[0] < rep->dat[0]))
+        {
+            if (rec->dat[0] <= stop_s - UPTIME_TOL)
+            {
+                diffs++;
+                report(shown, "%8.2fs <DAT> recorded, none replayed", rec->dat[0]);
+            }
+            r++;
+        }
+        else
+        {
+            if (rep->dat[0] <= record_end_s)
+            {
+                diffs++;
+                report(shown, "%8.2fs <DAT> replayed, none recorded", rep->dat[0]);
+            }
+            p++;
+        }
+    }
+    return diffs;
+}
+
+//wraps up the running boot; returns the next boot's index or -1 at the end
+static int finish_segment(bool reset)
+{
+    float stop_s = sim::now_us() / 1e6;
+    unsigned diffs = compare(stop_s);
+    bool recorded_reset = seg_end < events.size();
+    if (reset != recorded_reset)
+    {
+        diffs++;
+        printf("  %8.2fs %s\n", stop_s,
+               reset ? "firmware reset, the recording doesn't" : "recording reboots here, firmware didn't");
+    }
+    printf("replay: boot %u of %zu: %zu <DAT> recorded, %zu replayed, %u difference%s\n", opts.segment + 1, boots,
+           recorded.size(), replayed.size(), diffs, diffs == 1 ? "" : "s");
+    opts.mismatches += diffs;
+    return recorded_reset ? (int)opts.segment + 1 : -1;
+}
+
+static int summary()
+{
+    if (opts.mismatches)
+    {
+        printf("replay: %u difference%s\n", opts.mismatches, opts.mismatches == 1 ? "" : "s");
+        return 1;
+    }
+    printf("replay: match\n");
+    return 0;
+}
+
+std::vector<std::string> sim::replay_next_segment()
+{
+    int next = resume_at >= 0 ? resume_at : finish_segment(true);
+    if (next < 0)
+    {
+        fflush(stdout);
+        exit(summary());
+    }
+    char arg[48];
+    snprintf(arg, sizeof(arg), "--replay-resume=%d,%u", next, opts.mismatches);
+    return {arg};
+}
+
+bool sim::replaying()
+{
+    return active;
+}
+
+int sim::replay(const ReplayOptions &o)
+{
+    opts = o;
+    if (!load(opts.path))
+    {
+        return 2;
+    }
+
+    //find this boot's slice of the recording
+    std::vector<size_t> boot_at;
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        if (is_boot(events[i]))
+        {
+            boot_at.push_back(i);
+        }
+    }
+    boots = boot_at.size();
+    if (boot_at.empty())
+    {
+        fprintf(stderr, "%s: no \"boot\" in the recording: start recording before the controller boots, "
+                        "or send <RST> after starting\n",
+                opts.path);
+        return 2;
+    }
+    if (opts.segment >= boots)
+    {
+        fprintf(stderr, "%s: recording has only %zu boots\n", opts.path, boots);
+        return 2;
+    }
+    if (opts.segment == 0 && boot_at[0] > 0)
+    {
+        printf("replay: skipping %zu lines before the first boot\n", boot_at[0]);
+    }
+    seg_begin = boot_at[opts.segment];
+    seg_end = opts.segment + 1 < boots ? boot_at[opts.segment + 1] : events.size();
+
+    //the controller prints its uptime, so the earliest arrival of a <DAT>
+    //after its uptime pins down when it booted; the boot line is the fallback
+    offset_ms = events[seg_begin].host_ms;
+    std::vector<sim::PlantSample> samples;
+    for (size_t i = seg_begin; i < seg_end; i++)
+    {
+        if (events[i].dir != '<')
+        {
+            continue;
+        }
+        collect(events[i].text, recorded);
+        float v[DAT_FIELDS];
+        if (parse_dat(events[i].text, v))
+        {
+            int64_t start = (int64_t)events[i].host_ms - (int64_t)lround(v[0] * 1000);
+            offset_ms = start < offset_ms ? start : offset_ms;
+            //a <DAT> reports the temperatures converted right after the
+            //previous one; 0 means nothing has been converted yet
+            if (v[2] != 0 && v[3] != 0 && v[4] != 0)
+            {
+                float at = v[0] - LOOP_PERIOD / 1000.0f;
+                samples.push_back({(uint64_t)(at > 0 ? at * 1e6 : 0), {v[2], v[3]}, v[4]});
+            }
+        }
+    }
+    if (!samples.empty())
+    {
+        sim::plant_follow(samples);
+    }
+    else
+    {
+        printf("replay: no temperatures recorded for boot %u, using the thermal model\n", opts.segment + 1);
+    }
+
+    if (opts.seed_gains && !recorded.empty())
+    {
+        //the controller booted with the gains it reported first
+        EEPROM.put(EE_KP, recorded[0].dat[7]);
+        EEPROM.put(EE_KI, recorded[0].dat[8]);
+        EEPROM.put(EE_KD, recorded[0].dat[9]);
+    }
+
+    //faults still in place from earlier boots
+    for (size_t i = 0; i < seg_begin; i++)
+    {
+        if (events[i].dir == '!' && !apply_fault(events[i].text, true))
+        {
+            fprintf(stderr, "%s: unknown fault \"%s\"\n", opts.path, events[i].text.c_str());
+            return 2;
+        }
+    }
+
+    int64_t end_ms = 0;
+    for (size_t i = seg_begin; i < seg_end; i++)
+    {
+        end_ms = device_ms(events[i]) > end_ms ? device_ms(events[i]) : end_ms;
+    }
+    record_end_s = end_ms / 1000.0f;
+    uint64_t end_us = (uint64_t)end_ms * 1000 + 1500000; //let the last period finish
+
+    active = true;
+    sim::serial_set_tx_hook(on_tx);
+    setup();
+    size_t next = seg_begin + 1;
+    while (sim::now_us() < end_us)
+    {
+        for (; next < seg_end && device_ms(events[next]) * 1000 <= (int64_t)sim::now_us(); next++)
+        {
+            const Event &e = events[next];
+            if (e.dir == '<')
+            {
+                continue;
+            }
+            if (opts.verbose)
+            {
+                printf("%10.3f %c %s\n", sim::now_us() / 1e6, e.dir, e.text.c_str());
+            }
+            if (e.dir == '>')
+            {
+                sim::serial_inject(e.text.data(), e.text.size());
+            }
+            else if (!apply_fault(e.text, false))
+            {
+                fprintf(stderr, "%s: unknown fault \"%s\"\n", opts.path, e.text.c_str());
+                return 2;
+            }
+        }
+        loop();
+        sim::advance_us(opts.loop_us);
+    }
+
+    resume_at = finish_segment(false);
+    if (resume_at >= 0)
+    {
+        //the recorded controller rebooted but this one didn't: start the
+        //next boot from a clean slate anyway
+        sim::reset();
+    }
+    return summary();
+}
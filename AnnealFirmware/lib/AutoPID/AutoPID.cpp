@@ -6,6 +6,7 @@ AutoPID::AutoPID(float *input, float *setpoint, float *output, float outputMin,
   _input = input;
   _setpoint = setpoint;
   _output = output;
+  _feedForward = NULL;
   _outputMin = outputMin;
   _outputMax = outputMax;
   setGains(Kp, Ki, Kd);
@@ -19,6 +20,15 @@ void AutoPID::setGains(float Kp, float Ki, float Kd)
   _Kd = Kd;
 } //AutoPID::setControllerParams
 
+void AutoPID::setGainsBumpless(float Kp, float Ki, float Kd)
+{
+  if (_Ki != 0 && Ki != 0)
+  {
+    _integral *= _Ki / Ki;
+  }
+  setGains(Kp, Ki, Kd);
+} //AutoPID::setGainsBumpless
+
 void AutoPID::setBangBang(float bangOn, float bangOff)
 {
   _bangOn = bangOn;
@@ -30,6 +40,11 @@ void AutoPID::setBangBang(float bangRange)
   setBangBang(bangRange, bangRange);
 } //void AutoPID::setBangBang
 
+void AutoPID::setFeedForward(float *feedForward)
+{
+  _feedForward = feedForward;
+} //void AutoPID::setFeedForward
+
 void AutoPID::setOutputRange(float outputMin, float outputMax)
 {
   _outputMin = outputMin;
@@ -70,12 +85,21 @@ void AutoPID::run()
     if (_dT >= _timeStep)
     { //if long enough, do PID calculations
       _lastStep = millis();
+      float _bias = _feedForward ? *_feedForward : 0;
       float _error = *_setpoint - *_input;
-      _integral += (_error + _previousError) / 2 * _dT / 1000.0; //Riemann sum integral
-      _integral = constrain(_integral, _outputMin / _Ki, _outputMax / _Ki);
+      if (_Ki != 0)
+      {
+        _integral += (_error + _previousError) / 2 * _dT / 1000.0; //Riemann sum integral
+        //anti-windup: the integral covers only what the feed-forward leaves of the range
+        _integral = constrain(_integral, (_outputMin - _bias) / _Ki, (_outputMax - _bias) / _Ki);
+      }
+      else
+      {
+        _integral = 0; //nothing to bound it by, and a nonzero Ki later starts from here
+      }
       float _dError = (_error - _previousError) / (_dT / 1000.0); //derivative
       _previousError = _error;
-      float PID = (_Kp * _error) + (_Ki * _integral) + (_Kd * _dError);
+      float PID = _bias + (_Kp * _error) + (_Ki * _integral) + (_Kd * _dError);
       //*_output = _outputMin + (constrain(PID, 0, 1) * (_outputMax - _outputMin));
       *_output = constrain(PID, _outputMin, _outputMax);
     }
@@ -99,6 +123,11 @@ bool AutoPID::isStopped()
   return _stopped;
 }
 
+float AutoPID::getKi()
+{
+  return _Ki;
+}
+
 float AutoPID::getIntegral()
 {
   return _integral;
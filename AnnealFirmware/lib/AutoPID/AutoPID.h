@@ -11,10 +11,16 @@ public:
           float Kp, float Ki, float Kd);
   // Allows manual adjustment of gains
   void setGains(float Kp, float Ki, float Kd);
+  // Changes gains while running: the integral is rescaled so Ki * integral,
+  // and with it the output, doesn't jump
+  void setGainsBumpless(float Kp, float Ki, float Kd);
   // Sets bang-bang control ranges, separate upper and lower offsets, zero for off
   void setBangBang(float bangOn, float bangOff);
   // Sets bang-bang control range +-single offset
   void setBangBang(float bangRange);
+  // Adds a feed-forward term to the output, read through the pointer on every
+  // update; the PID then only has to make up the difference. NULL for none
+  void setFeedForward(float *feedForward);
   // Allows manual readjustment of output range
   void setOutputRange(float outputMin, float outputMax);
   // Allows manual adjustment of time step (default 1000ms)
@@ -29,6 +35,7 @@ public:
   void reset();
   bool isStopped();
 
+  float getKi();
   float getIntegral();
   void setIntegral(float integral);
 
@@ -36,7 +43,7 @@ private:
   float _Kp, _Ki, _Kd;
   float _integral, _previousError;
   float _bangOn, _bangOff;
-  float *_input, *_setpoint, *_output;
+  float *_input, *_setpoint, *_output, *_feedForward;
   float _outputMin, _outputMax;
   unsigned long _timeStep, _lastStep;
   bool _stopped;
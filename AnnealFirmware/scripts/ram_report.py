@@ -0,0 +1,67 @@
+# Static RAM by module, printed after every board build (extra_scripts in
+# platformio.ini). Read from the linker map, so it counts what is left after
+# unused sections were dropped. Whatever the total leaves of the UNO's 2KB is
+# shared by the stack and the heap; <MEM> reports how much of it is used.
+import os
+import re
+from collections import defaultdict
+
+Import("env")
+
+RAM_SIZE = 2048
+RAM_START = 0x800100  # data space as avr-ld addresses it
+MAP = os.path.join(env.subst("$BUILD_DIR"), "firmware.map")
+
+env.Append(LINKFLAGS=["-Wl,-Map," + MAP])
+
+# an input section, e.g. " .bss.rxbuf  0x008001f2  0x40 .pio/build/uno/src/comms.cpp.o";
+# long names put the address, size and file on the next line
+SECTION = re.compile(r"^ (\.(?:data|bss|rodata)\S*)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(.+))?$")
+PLACEMENT = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(.+)$")
+
+
+def module(path):
+    # archive members come as lib.a(member.o)
+    m = re.search(r"\(([^)]+)\)$", path)
+    name = os.path.basename(m.group(1) if m else path)
+    return re.sub(r"\.o$", "", name)
+
+
+def ram_by_module():
+    sizes = defaultdict(lambda: [0, 0])  # initialised (.data), zeroed (.bss)
+    with open(MAP) as f:
+        lines = f.read().split("Linker script and memory map", 1)[-1].splitlines()
+    pending = None
+    for line in lines:
+        m = SECTION.match(line)
+        if m and not m.group(2):
+            pending = m.group(1)
+            continue
+        if m:
+            name, addr, size, path = m.groups()
+        elif pending and PLACEMENT.match(line):
+            name = pending
+            addr, size, path = PLACEMENT.match(line).groups()
+        else:
+            pending = None
+            continue
+        pending = None
+        if int(addr, 16) < RAM_START or not int(size, 16):
+            continue
+        sizes[module(path.strip())][name.startswith(".bss")] += int(size, 16)
+    return sizes
+
+
+def report(source, target, env):
+    sizes = ram_by_module()
+    total = 0
+    print("static RAM by module, bytes")
+    print("%-28s %6s %6s %6s" % ("", "data", "bss", "total"))
+    for name, (data, bss) in sorted(sizes.items(), key=lambda i: -sum(i[1])):
+        print("%-28s %6d %6d %6d" % (name, data, bss, data + bss))
+        total += data + bss
+    print("%-28s %20d" % ("total", total))
+    print("%-28s %20d" % ("left for stack and heap", RAM_SIZE - total))
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", report)
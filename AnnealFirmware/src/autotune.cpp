@@ -0,0 +1,178 @@
+#include "autotune.h"
+#include "comms.h"
+#include "AutoPID.h"
+#include "mimo.h"
+#include "feedforward.h"
+
+extern float goal_temp, Kp, Ki, Kd;
+extern float temp_A, temp_B, duty_A, duty_B, ff_A, ff_B;
+extern AutoPID pid_A, pid_B;
+
+#define RELAY_HYSTERESIS 0.2 //degC; keeps thermocouple noise from chattering the relay
+#define MIN_CYCLES 3         //full oscillations measured before the result can be trusted
+#define MAX_CYCLES 20        //give up if the oscillation hasn't settled by then
+#define SETTLED 0.1          //last two periods and amplitudes agree to 10%
+
+struct Relay
+{
+    float *temp, *duty;
+    float bias;            //duty the relay switches around, % (corrected every cycle)
+    bool high;             //heating half of the cycle
+    uint32_t rise_ms;      //last switch to heating, 0 before the first
+    uint32_t high_ms;      //length of the last heating half
+    float t_max, t_min;    //extremes since rise_ms
+    float Tu, a;           //period (s) and amplitude (degC) of the last cycle
+    uint8_t cycles;        //cycles measured
+    bool settled;
+};
+
+static Relay relay[2] = {{&temp_A, &duty_A, 0, false, 0, 0, 0, 0, 0, 0, 0, false},
+                         {&temp_B, &duty_B, 0, false, 0, 0, 0, 0, 0, 0, 0, false}};
+static bool running, save_when_done;
+static float amplitude;
+
+void autotune_start(float amp, bool save)
+{
+    amplitude = constrain(amp, 5, 50);
+    save_when_done = save;
+    for (Relay &r : relay)
+    {
+        r.bias = 50;
+        r.high = false;
+        r.rise_ms = 0;
+        r.cycles = 0;
+        r.settled = false;
+    }
+    running = true;
+}
+
+void autotune_stop()
+{
+    running = false;
+}
+
+bool autotune_running()
+{
+    return running;
+}
+
+static void relay_update(Relay &r, uint32_t ms)
+{
+    float temp = *r.temp;
+    float error = goal_temp - temp;
+    r.t_max = max(r.t_max, temp);
+    r.t_min = min(r.t_min, temp);
+    if (!r.high && error > RELAY_HYSTERESIS)
+    {
+        //fell below the setpoint: a full cycle ends here
+        if (r.rise_ms)
+        {
+            uint32_t period = ms - r.rise_ms;
+            float Tu = period / 1000.0;
+            float a = (r.t_max - r.t_min) / 2;
+            //the first cycle still carries the approach to the setpoint
+            bool repeated = r.cycles++ && fabs(Tu - r.Tu) < SETTLED * Tu && fabs(a - r.a) < SETTLED * a;
+            r.settled = repeated && r.cycles > MIN_CYCLES;
+            r.Tu = Tu;
+            r.a = a;
+            //heat for as long as it cools: if the heating half was the shorter
+            //one, the bias is above what holding the setpoint takes
+            r.bias += amplitude * ((float)r.high_ms - (float)(period - r.high_ms)) / period;
+            r.bias = constrain(r.bias, amplitude, 100 - amplitude);
+        }
+        r.high = true;
+        r.rise_ms = ms;
+        r.t_max = r.t_min = temp;
+    }
+    else if (r.high && error < -RELAY_HYSTERESIS)
+    {
+        r.high = false;
+        r.high_ms = ms - r.rise_ms;
+    }
+    *r.duty = r.bias + (r.high ? amplitude : -amplitude);
+}
+
+static float ultimate_gain(const Relay &r)
+{
+    //hysteresis shifts the switching points: a describes the oscillation
+    //only once it is corrected for it
+    float a = sqrt(max(r.a * r.a - RELAY_HYSTERESIS * RELAY_HYSTERESIS, 1e-6));
+    return 4 * amplitude / (PI * a);
+}
+
+//Tyreus-Luyben: less overshoot than Ziegler-Nichols, which suits slow
+//zones with dead time
+static void gains_for(const Relay &r, float &p, float &i, float &d)
+{
+    p = ultimate_gain(r) / 2.2;
+    i = p / (2.2 * r.Tu);
+    d = p * r.Tu / 6.3;
+}
+
+//<ATN,result,Ku A,Tu A,Ku B,Tu B[,zone of Kp,of Ki,of Kd]>: both zones' results,
+//and with OK which zone each of the gains in use came from
+static void report(const __FlashStringHelper *result, const char *from)
+{
+    Serial.print(F("<ATN,"));
+    Serial.print(result);
+    for (const Relay &r : relay)
+    {
+        Serial.print(',');
+        Serial.print(ultimate_gain(r), 3);
+        Serial.print(',');
+        Serial.print(r.Tu, 1);
+    }
+    for (uint8_t k = 0; from && k < 3; k++)
+    {
+        Serial.print(',');
+        Serial.print(from[k]);
+    }
+    Serial.println('>');
+}
+
+void autotune_update()
+{
+    uint32_t ms = millis();
+    relay_update(relay[0], ms);
+    relay_update(relay[1], ms);
+
+    if (relay[0].cycles > MAX_CYCLES || relay[1].cycles > MAX_CYCLES)
+    {
+        //never settled: leave the old gains alone
+        running = false;
+        *relay[0].duty = *relay[1].duty = 0;
+        report(F("FAIL"), NULL);
+        return;
+    }
+    if (!relay[0].settled || !relay[1].settled)
+    {
+        return;
+    }
+
+    //both channels share one set of gains: the smaller of each, so neither
+    //channel is driven harder than its own tuning says
+    float p[2], i[2], d[2];
+    gains_for(relay[0], p[0], i[0], d[0]);
+    gains_for(relay[1], p[1], i[1], d[1]);
+    Kp = min(p[0], p[1]);
+    Ki = min(i[0], i[1]);
+    Kd = min(d[0], d[1]);
+    const char from[3] = {p[0] <= p[1] ? 'A' : 'B', i[0] <= i[1] ? 'A' : 'B', d[0] <= d[1] ? 'A' : 'B'};
+    pid_A.setGains(Kp, Ki, Kd);
+    pid_B.setGains(Kp, Ki, Kd);
+    mimo_set_gains(Kp, Ki, Kd);
+    //pick up from the relay's average output, not from whatever the PID had.
+    //the feed-forward is added on top of the PID, so the integral only holds
+    //what it leaves of the bias
+    pid_A.reset();
+    pid_B.reset();
+    ff_update();
+    pid_A.setIntegral((relay[0].bias - ff_A) / Ki);
+    pid_B.setIntegral((relay[1].bias - ff_B) / Ki);
+    if (save_when_done)
+    {
+        save_gains();
+    }
+    running = false;
+    report(F("OK"), from);
+}
@@ -2,20 +2,40 @@
 #include <avr/wdt.h> //for reset
 #include <EEPROM.h>  //for storing PID params
 #include "AutoPID.h"
+#include "autotune.h"
+#include "heater.h"
+#include "thermocouple.h"
+#include "mimo.h"
+#include "feedforward.h"
+#include "schedule.h"
+#include "storage.h"
+#include "trace.h"
+#include "protocol.h"
 
 extern float goal_temp, Kp, Ki, Kd;
 extern uint8_t estop, rx_flag;
 extern AutoPID pid_A, pid_B;
 
 char rxbuf[RXBUF_LEN]; //stores received character string
-char cmd[4] = {0};
 
-//serial commands:
+//serial commands (names and arguments: protocol.h):
 //<SET,100.0> set temperature
 //<OFF> emergency stop
 //<RST> reboot
 //<PID,1.0,2.2,0.35> try new PID gains
 //<SAV> write PID gains to eeprom
+//<NOP> keepalive, only restarts the comms timeout
+//<ATN,50,1> autotune PID gains around the setpoint (relay amplitude %, 1=save when done)
+//<GRD,-200.0,1.5> regulate mean temperature and gradient (A - B) instead
+//<DCM,1.0,0.3,0.3,1.0> zone/heater coupling matrix for GRD (degC per % duty: AA, AB, BA, BB)
+//<GSE,0,-250.0,2.0,0.05,0.0> gain schedule breakpoint (index, temperature, Kp, Ki, Kd)
+//<GSN,3,0> schedule gains over breakpoints 0..2 (0=by setpoint, 1=by measured temp.); <GSN,0> fixed gains
+//<PWR,120> peak heater power budget in W
+//<HLT> send the ADC link health counters now
+//<MEM> send RAM use: static bytes, free now, least free since boot
+//<FFM,A,0.9,-250.0> feed-forward model for zone A (degC per % duty, temp. with heater off); K=0 turns it off
+//<BCL> learn the burnout check baselines, with both thermocouples intact, and write them to eeprom
+//any of them with a sequence number, <SET,100.0,#17>, is answered with <ACK,17,...> or <NAK,17,code>
 
 void reboot()
 {
@@ -25,47 +45,107 @@ void reboot()
         ;
 }
 
-bool parse_rx()
+void save_gains()
 {
-    char *ptr; // this is used by strtok() as an index
+    //write PID params to EEPROM
+    EEPROM.put(EE_KP, Kp);
+    EEPROM.put(EE_KI, Ki);
+    EEPROM.put(EE_KD, Kd);
+    mimo_save();
+    schedule_save();
+    ff_save();
+    EEPROM.put(EE_POWER_BUDGET, heaters_get_budget());
+}
 
-    ptr = strtok(rxbuf, ","); //replace commas with null terminators, then return ptr to first part (cmd)
-    if (strlen(ptr) != 3)     //cmd strings must be 3 chars
+//answers a command that came with a sequence number: the values as applied,
+//for the commands that set one
+static void ack_tx(const Command &c)
+{
+    if (c.seq == PROTO_NO_SEQ)
     {
-        return false;
+        return;
+    }
+    Serial.print(F("<ACK,"));
+    Serial.print(c.seq);
+    Serial.print(',');
+    Serial.print(c.tag);
+    switch (c.id)
+    {
+    case PROTO_SET:
+        Serial.print(',');
+        Serial.print(goal_temp);
+        break;
+    case PROTO_GRD:
+        Serial.print(',');
+        Serial.print(goal_temp);
+        Serial.print(',');
+        Serial.print(mimo_gradient_setpoint());
+        break;
+    case PROTO_PID:
+        Serial.print(',');
+        Serial.print(Kp, 5);
+        Serial.print(',');
+        Serial.print(Ki, 5);
+        Serial.print(',');
+        Serial.print(Kd, 5);
+        break;
+    case PROTO_PWR:
+        Serial.print(',');
+        Serial.print(heaters_get_budget());
+        break;
     }
-    strcpy(cmd, ptr); // copy it to the cmd string
+    Serial.println('>');
+}
 
-    //take different action depending on cmd
-    if (strcmp(cmd, "SET") == 0)
+static void nak_tx(const Command &c, uint8_t code)
+{
+    if (c.seq == PROTO_NO_SEQ)
     {
-        ptr = strtok(NULL, ","); // NULL arg continues using old string and moves ptr ahead
-        goal_temp = atof(ptr);   // convert next part to a float
+        return;
+    }
+    Serial.print(F("<NAK,"));
+    Serial.print(c.seq);
+    Serial.print(',');
+    Serial.print(code);
+    Serial.println('>');
+}
+
+//a whole number 0..most. anything else (negative, fractional, NaN, too big)
+//would wrap or be undefined when cast to an index
+static bool is_index(float x, uint8_t most)
+{
+    return x >= 0 && x <= most && x == (uint8_t)x;
+}
+
+static bool run_command(const Command &c)
+{
+    const float *arg = c.arg;
+
+    //take different action depending on the command
+    switch (c.id)
+    {
+    case PROTO_SET:
+        goal_temp = arg[0];
         estop = 0;
+        autotune_stop(); //it was tuning for the old setpoint
+        mimo_disable();  //back to one loop per zone
 #ifdef COMMS_DEBUG
         Serial.println(goal_temp);
 #endif
         return true;
-    }
-    else if (strcmp(cmd, "OFF") == 0)
-    {
+    case PROTO_OFF:
         estop = 1;
         return true;
-    }
-    else if (strcmp(cmd, "RST") == 0)
-    {
+    case PROTO_RST:
+        ack_tx(c); //nothing after the reset will
+        Serial.flush();
         reboot();
         return true; //never reached. avoids warnings.
-    }
-    else if (strcmp(cmd, "PID") == 0)
-    {
+    case PROTO_PID:
         //use new PID parameters
-        ptr = strtok(NULL, ",");
-        Kp = atof(ptr);
-        ptr = strtok(NULL, ",");
-        Ki = atof(ptr);
-        ptr = strtok(NULL, ",");
-        Kd = atof(ptr);
+        Kp = arg[0];
+        Ki = arg[1];
+        Kd = arg[2];
 #ifdef COMMS_DEBUG
         Serial.println(Kp);
         Serial.println(Ki);
@@ -73,23 +153,81 @@ bool parse_rx()
 #endif
         pid_A.setGains(Kp, Ki, Kd);
         pid_B.setGains(Kp, Ki, Kd);
+        mimo_set_gains(Kp, Ki, Kd);
+        autotune_stop();    //hand-picked gains win
+        schedule_disable(); //over the schedule too
+        return true;
+    case PROTO_SAV:
+        save_gains();
+        return true;
+    case PROTO_ATN:
+        //both fields are optional
+        autotune_start(c.argc > 0 ? arg[0] : AUTOTUNE_AMPLITUDE, c.argc > 1 && arg[1]);
+        schedule_disable(); //the result is one set of gains
+        estop = 0;
+        return true;
+    case PROTO_GRD:
+        goal_temp = arg[0]; //mean of the two zones
+        mimo_enable(arg[1]);
+        estop = 0;
+        autotune_stop();
+        return true;
+    case PROTO_DCM:
+        return mimo_set_coupling(arg[0], arg[1], arg[2], arg[3]); //refuses a singular matrix
+    case PROTO_GSE:
+        if (!is_index(arg[0], SCHEDULE_MAX - 1))
+        {
+            return false;
+        }
+        return schedule_set_point((uint8_t)arg[0], arg[1], arg[2], arg[3], arg[4]);
+    case PROTO_GSN:
+        if (!is_index(arg[0], SCHEDULE_MAX) || (c.argc > 1 && !is_index(arg[1], SCHEDULE_BY_TEMP)))
+        {
+            return false;
+        }
+        //refuses breakpoints never set
+        return schedule_enable((uint8_t)arg[0], c.argc > 1 ? (uint8_t)arg[1] : SCHEDULE_BY_SETPOINT);
+    case PROTO_PWR:
+        if (arg[0] < HEATER_POWER_W)
+        {
+            return false; //would keep every heater off
+        }
+        heaters_set_budget(min(arg[0], 65535.0));
+        return true;
+    case PROTO_FFM:
+        return ff_set_model(arg[0], arg[1], arg[2]);
+    case PROTO_BCL:
+        adc_burnout_learn(); //answers with <BCL,...> once done
+        return true;
+    case PROTO_HLT:
+        health_tx();
+        return true;
+    case PROTO_MEM:
+        memory_tx();
+        return true;
+    case PROTO_NOP:
+        //nothing to do: a valid packet restarts the comms timeout by itself
         return true;
     }
-    else if (strcmp(cmd, "SAV") == 0)
+    return false;
+}
+
+bool parse_rx()
+{
+    //commands and their arguments are checked against the table in protocol.h
+    Command c;
+    if (!proto_decode(rxbuf, c))
     {
-        //write PID params to EEPROM
-        uint8_t addr = 0;
-        EEPROM.put(addr, Kp);
-        addr += sizeof(float);
-        EEPROM.put(addr, Ki);
-        addr += sizeof(float);
-        EEPROM.put(addr, Kd);
-        return true;
+        nak_tx(c, PROTO_NAK_INVALID);
+        return false;
     }
-    else
+    if (!run_command(c))
     {
-        return false; //did not match any of the valid commands
+        nak_tx(c, PROTO_NAK_REFUSED);
+        return false;
     }
+    ack_tx(c);
+    return true;
 }
 
 #define STARTMARKER '<'
@@ -124,6 +262,7 @@ void serial_rx()
                 Serial.println(rxbuf);
 #endif
                 rx_flag = 1;
+                TRACE(TRACE_RX_COMPLETE);
             }
         }
 
@@ -0,0 +1,88 @@
+#include "events.h"
+#include "pins.h"
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+static volatile uint8_t pending;
+static uint8_t sense_levels; //heater A sense in bit 0, B in bit 1
+static uint32_t last_tick;
+
+static uint8_t read_sense()
+{
+    return digitalRead(HT_A_SNS) | digitalRead(HT_B_SNS) << 1;
+}
+
+//DRDY shares port B (PCINT0) with heater A's sense line, heater B's is on
+//port D (PCINT2). MISO also toggles during SPI transfers, so a DRDY event
+//only says to go and look.
+static void pins_changed()
+{
+    if (!digitalRead(ADC_MISO_DRDY))
+    {
+        pending |= EV_DRDY;
+    }
+    uint8_t sense = read_sense();
+    if (sense != sense_levels)
+    {
+        sense_levels = sense;
+        pending |= EV_FAULT;
+    }
+}
+
+ISR(PCINT0_vect)
+{
+    pins_changed();
+}
+
+ISR(PCINT2_vect)
+{
+    pins_changed();
+}
+
+static void watch_pin(uint8_t pin)
+{
+    *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+    *digitalPinToPCICR(pin) |= _BV(digitalPinToPCICRbit(pin));
+}
+
+void events_begin()
+{
+    sense_levels = read_sense();
+    last_tick = millis();
+    watch_pin(ADC_MISO_DRDY);
+    watch_pin(HT_A_SNS);
+    watch_pin(HT_B_SNS);
+    set_sleep_mode(SLEEP_MODE_IDLE); //Timer0, UART and SPI keep running
+}
+
+uint8_t events_wait()
+{
+    for (;;)
+    {
+        cli();
+        uint8_t events = pending;
+        pending = 0;
+        uint32_t ms = millis();
+        if (ms != last_tick)
+        {
+            last_tick = ms;
+            events |= EV_TICK;
+        }
+        if (Serial.available())
+        {
+            events |= EV_RX;
+        }
+        if (events)
+        {
+            sei();
+            return events;
+        }
+        //sei only takes effect after the next instruction, so an interrupt
+        //that came in since the checks above still wakes us from this sleep
+        //instead of slipping in before it
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }
+}
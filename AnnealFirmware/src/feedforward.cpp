@@ -0,0 +1,107 @@
+#include "feedforward.h"
+#include "storage.h"
+#include "AutoPID.h"
+#include <EEPROM.h>
+
+extern const uint16_t LOOP_PERIOD;
+extern float goal_temp;
+extern float temp_A, temp_B, duty_A, duty_B, ff_A, ff_B;
+extern AutoPID pid_A, pid_B;
+
+#define LEARN_BAND 0.5  //degC from the setpoint that counts as sitting at it
+#define LEARN_SETTLE 30 //periods in the band before the duty says anything
+#define LEARN_RATE 0.02 //fraction of the T0 error taken out per period
+
+struct Model
+{
+    float K, T0;
+};
+
+Model model[2];
+
+struct Zone
+{
+    float *temp, *duty, *ff;
+    AutoPID *pid;
+    uint8_t settled; //periods in a row within LEARN_BAND
+};
+
+static Zone zone[2] = {{&temp_A, &duty_A, &ff_A, &pid_A, 0}, {&temp_B, &duty_B, &ff_B, &pid_B, 0}};
+static uint32_t last_update;
+
+bool ff_set_model(uint8_t channel, float K, float T0)
+{
+    if (channel > 1 || isnan(K) || isnan(T0) || K < 0)
+    {
+        return false;
+    }
+    model[channel] = {K, T0};
+    zone[channel].settled = 0;
+    return true;
+}
+
+void ff_begin()
+{
+    Model m[2];
+    EEPROM.get(EE_FEEDFORWARD, m);
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        if (!ff_set_model(i, m[i].K, m[i].T0))
+        {
+            ff_set_model(i, 0, 0); //nothing stored: no feed-forward
+        }
+    }
+}
+
+void ff_save()
+{
+    EEPROM.put(EE_FEEDFORWARD, model);
+}
+
+static void learn(Zone &z, Model &m)
+{
+    //the duty is only the steady-state duty once the zone has stopped moving,
+    //and says nothing while the heater is pinned at either end
+    if (fabs(goal_temp - *z.temp) > LEARN_BAND || *z.duty <= 0 || *z.duty >= 100)
+    {
+        z.settled = 0;
+        return;
+    }
+    if (z.settled < LEARN_SETTLE)
+    {
+        z.settled++;
+        return;
+    }
+    float step = LEARN_RATE * (*z.temp - m.K * *z.duty - m.T0);
+    m.T0 += step;
+    //the feed-forward drops by step/K: hand that to the integral so the
+    //output doesn't move
+    float Ki = z.pid->getKi();
+    if (Ki != 0)
+    {
+        z.pid->setIntegral(z.pid->getIntegral() + step / m.K / Ki);
+    }
+}
+
+void ff_update()
+{
+    uint32_t ms = millis();
+    bool continuous = ms - last_update < 2 * LOOP_PERIOD; //the PIDs ran last period too
+    last_update = ms;
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        Zone &z = zone[i];
+        Model &m = model[i];
+        if (m.K == 0)
+        {
+            *z.ff = 0;
+            continue;
+        }
+        if (!continuous)
+        {
+            z.settled = 0;
+        }
+        learn(z, m);
+        *z.ff = constrain((goal_temp - m.T0) / m.K, 0, 100);
+    }
+}
@@ -2,18 +2,23 @@
 
 extern const uint16_t LOOP_PERIOD;
 
+uint16_t power_budget_w = 0xFFFF;
+
 void Heater::begin()
 {
     //switch pin is an output. heater off to start.
     pinMode(switch_pin, OUTPUT);
     digitalWrite(switch_pin, LOW);
+    on = false;
 
     pinMode(sense_pin, INPUT_PULLUP);
+    sense();
 }
 
 void Heater::update(uint16_t ms)
 {
-    //heater on from period start->period start+period length*duty cycle
+    //heater on from on_start_ms->on_start_ms+period length*duty cycle,
+    //wrapping around the end of the period
     uint8_t state = 0;
     if (duty == 0)
     {
@@ -25,15 +30,24 @@ void Heater::update(uint16_t ms)
     }
     else
     {
-        state = (ms < on_time_ms) ? 1 : 0;
+        state = ((ms + LOOP_PERIOD - on_start_ms) % LOOP_PERIOD < on_time_ms) ? 1 : 0;
+    }
+    if (state != on)
+    {
+        on = state;
+        digitalWrite(switch_pin, state);
     }
-    digitalWrite(switch_pin, state);
+}
+
+void Heater::sense()
+{
     powered = digitalRead(sense_pin);
 }
 
 void Heater::shutdown()
 {
     set_duty(0);
+    on = false;
     digitalWrite(switch_pin, LOW);
 }
 
@@ -43,12 +57,62 @@ void Heater::set_duty(uint8_t duty)
     on_time_ms = (uint16_t)((float)LOOP_PERIOD / 100.0 * duty);
 }
 
+void Heater::set_phase(uint16_t start_ms)
+{
+    on_start_ms = start_ms % LOOP_PERIOD;
+}
+
 uint8_t Heater::get_duty()
 {
     return duty;
 }
 
+uint16_t Heater::get_on_time()
+{
+    return on_time_ms;
+}
+
 bool Heater::has_power()
 {
     return powered;
+}
+
+float heaters_schedule(Heater *const heaters[], uint8_t n)
+{
+    //how many channels the budget lets conduct at the same time
+    uint8_t slots = min(power_budget_w / HEATER_POWER_W, n);
+    uint16_t total = 0;
+    for (uint8_t i = 0; i < n; i++)
+    {
+        total += heaters[i]->get_duty();
+    }
+    float granted = 1;
+    if (total > slots * 100)
+    {
+        //rounded down, so the scaled duties never add up to more than allowed
+        for (uint8_t i = 0; i < n; i++)
+        {
+            heaters[i]->set_duty((uint16_t)heaters[i]->get_duty() * slots * 100 / total);
+        }
+        granted = (float)slots * 100 / total;
+    }
+    //one after the other around the period: at any moment no more channels
+    //are on than the total on-time covers whole periods, rounded up
+    uint16_t start = 0;
+    for (uint8_t i = 0; i < n; i++)
+    {
+        heaters[i]->set_phase(start);
+        start = (start + heaters[i]->get_on_time()) % LOOP_PERIOD;
+    }
+    return granted;
+}
+
+void heaters_set_budget(uint16_t watts)
+{
+    power_budget_w = watts;
+}
+
+uint16_t heaters_get_budget()
+{
+    return power_budget_w;
 }
\ No newline at end of file
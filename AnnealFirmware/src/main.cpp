@@ -5,9 +5,18 @@
 #include "heater.h"
 #include "leds.h"
 #include "AutoPID.h"
+#include "autotune.h"
+#include "mimo.h"
+#include "feedforward.h"
+#include "schedule.h"
+#include "storage.h"
 #include "comms.h"
 #include "manual.h"
 #include "pins.h"
+#include "trace.h"
+#include "events.h"
+#include "ram.h"
+#include "protocol.h"
 #include <avr/wdt.h>
 
 //settings
@@ -18,11 +27,13 @@ const uint16_t LOOP_PERIOD = 1000;
 //global variables
 Heater ht_A(HT_A_SW, HT_A_SNS);
 Heater ht_B(HT_B_SW, HT_B_SNS);
+Heater *const heaters[] = {&ht_A, &ht_B};
 
 float goal_temp = -50.0;
 float internal_temp; //ADC (cold-junction) temperature
 float Kp, Ki, Kd;
 float temp_A, temp_B, duty_A, duty_B;
+float ff_A, ff_B; //feed-forward duty under each PID
 AutoPID pid_A(&temp_A, &goal_temp, &duty_A, 0, 100, 0, 0, 0);
 AutoPID pid_B(&temp_B, &goal_temp, &duty_B, 0, 100, 0, 0, 0);
 
@@ -36,29 +47,39 @@ bool errchk();
 #define STATE_CONVERT_TC_A 2
 #define STATE_CONVERT_TC_B 3
 #define STATE_ADC_IDLE 4
+#define STATE_BURNOUT_A 5 //burnout check, after the PID has its readings
+#define STATE_BURNOUT_B 6
 uint8_t state = STATE_ADC_IDLE;
 
 uint32_t ms;
 uint16_t t;
 uint32_t last_period_start;
+uint32_t outputs_start; //the heaters' own period starts when they get their duties
 uint32_t last_rx = 0;
 uint8_t comms_ok = 0;
 uint8_t rx_flag;
+uint16_t health_sent; //ADC resets in the last <HLT> packet
 
 void setup()
 {
   Serial.begin(250000);
-  Serial.println("boot");
+  Serial.println(F("boot"));
+  TRACE_BEGIN();
 
   adc_init();
 
   ht_A.begin();
   ht_B.begin();
+  uint16_t budget;
+  EEPROM.get(EE_POWER_BUDGET, budget);
+  //erased EEPROM: no limit. anything <PWR> would refuse: no limit either,
+  //rather than every heater off
+  heaters_set_budget(budget < HEATER_POWER_W ? 0xFFFF : budget);
 
   //load PID gains from EEPROM
-  EEPROM.get(0, Kp);
-  EEPROM.get(sizeof(float), Ki);
-  EEPROM.get(sizeof(float) * 2, Kd);
+  EEPROM.get(EE_KP, Kp);
+  EEPROM.get(EE_KI, Ki);
+  EEPROM.get(EE_KD, Kd);
   if (Kp == NAN || Ki == NAN || Kd == NAN)
   {
     //if the EEPROM data are corrupted anywhere, set all the gains to zero
@@ -67,8 +88,15 @@ void setup()
   }
   pid_A.setGains(Kp, Ki, Kd);
   pid_B.setGains(Kp, Ki, Kd);
+  mimo_set_gains(Kp, Ki, Kd);
+  mimo_begin();
+  pid_A.setFeedForward(&ff_A);
+  pid_B.setFeedForward(&ff_B);
+  ff_begin();
+  schedule_begin(); //overrides the gains above from the first period on, if enabled
 
   leds_begin(); //startup blink gives ~1000ms time for TC amps to stabilize
+  events_begin();
 
   if (check_manual_sw())
   { //switch set for MANUAL
@@ -76,100 +104,228 @@ void setup()
   } //switch set for CPU => continue to main program
 }
 
+//shuts the heaters down at once on estop. only needed when estop may have
+//changed: after a command, a comms timeout or an error at the period end
+void check_estop()
+{
+  if (estop)
+  {
+    autotune_stop();
+    ht_A.shutdown();
+    ht_B.shutdown();
+  }
+}
+
+//hands the heaters the PID outputs, their on-times laid out from now on:
+//right after a PID run, so the outputs don't wait for the next period, or
+//when a command takes us out of estop with the heaters all off. the phases
+//only move here, so a heater switches on and off at most once in between
+void apply_outputs()
+{
+  if (estop)
+  {
+    return;
+  }
+  ht_A.set_duty(duty_A);
+  ht_B.set_duty(duty_B);
+  float granted = heaters_schedule(heaters, 2); //stagger the on-times, cap the peak power
+  //anti-windup: what the budget held back, the loops would only integrate
+  //up, so they are capped at what the heaters got until it lets go
+  pid_A.setOutputRange(0, granted < 1 ? ht_A.get_duty() : 100);
+  pid_B.setOutputRange(0, granted < 1 ? ht_B.get_duty() : 100);
+  mimo_limit(granted);
+  outputs_start = ms;
+  ht_A.update(0);
+  ht_B.update(0);
+}
+
+//how far the heaters are into their period. held at its last millisecond
+//when the next PID run is late, rather than starting over on the old duties
+uint16_t outputs_position()
+{
+  return min(ms - outputs_start, (uint32_t)LOOP_PERIOD - 1);
+}
+
+//a failed burnout check takes its heater off at once rather than at the end
+//of the period, where the error stops everything
+void burnout_stop(uint8_t err, Heater &ht, float &temp, float &duty)
+{
+  if (adc_get_errcode() & err)
+  {
+    temp = 0;  //reported like a wild reading
+    duty = 0;  //stays off if a command applies the outputs before then
+    ht.shutdown();
+  }
+}
+
 //todo: global 1Hz period variable
 void loop()
 {
+  //idle sleep until a timer tick, DRDY, a received byte or a fuse line wakes us
+  uint8_t events = events_wait();
   //avoid repeated calls to millis() since interrupts are disabled there
   ms = millis();
   //t = how far we are into current period, in milliseconds
   t = ms - last_period_start;
-  switch (state)
-  {
-  case STATE_CONVERT_INTERNAL:
-    if (adc_is_conversion_ready())
-    {
-      internal_temp = adc_to_internal_temp(adc_read_conversion());
-      state = STATE_CONVERT_TC_A;
-      adc_select_channel(ADC_CHANNEL_TC_A);
-      adc_start_conversion();
-    }
-    break;
-  case STATE_CONVERT_TC_A:
 
-    if (adc_is_conversion_ready())
+  //ADC sequence moves on when DRDY falls; ticks catch the conversion
+  //timeout and the start of the next period
+  if (events & (EV_DRDY | EV_TICK))
+  {
+    int16_t adc;
+    uint8_t result = state == STATE_ADC_IDLE ? ADC_BUSY : adc_poll(adc);
+    if (result == ADC_FAULT)
     {
-      temp_A = adc_to_thermocouple_temp(adc_read_conversion(), internal_temp);
-      state = STATE_CONVERT_TC_B;
-      adc_select_channel(ADC_CHANNEL_TC_B);
+      //the ADC has been reset: take the whole sequence again, usually
+      //there is time left in the period for it. the burnout check only
+      //starts itself over, the PID already ran on this period's readings
+      if (state == STATE_BURNOUT_A || state == STATE_BURNOUT_B)
+      {
+        state = STATE_BURNOUT_A;
+        adc_select_channel(ADC_CHANNEL_BURNOUT_A);
+      }
+      else
+      {
+        state = STATE_CONVERT_INTERNAL;
+        adc_select_channel(ADC_CHANNEL_INTERNAL_TEMP);
+      }
       adc_start_conversion();
+      result = ADC_BUSY;
     }
-    break;
-  case STATE_CONVERT_TC_B:
-    if (adc_is_conversion_ready())
+    switch (state)
     {
-      temp_B = adc_to_thermocouple_temp(adc_read_conversion(), internal_temp);
-      //recalculate PID outputs after getting new temp. readings from both sensors
-      if (!estop)
+    case STATE_CONVERT_INTERNAL:
+      if (result == ADC_DONE)
       {
-        pid_A.run();
-        pid_B.run();
+        adc_store(ADC_CHANNEL_INTERNAL_TEMP, adc);
+        state = STATE_CONVERT_TC_A;
+        adc_select_channel(ADC_CHANNEL_TC_A);
+        adc_start_conversion();
       }
-      state = STATE_ADC_IDLE;
-    }
-    break;
-  case STATE_ADC_IDLE:
-    if (t >= LOOP_PERIOD)
-    {
-      state = STATE_CONVERT_INTERNAL;
-      adc_select_channel(ADC_CHANNEL_INTERNAL_TEMP);
-      adc_start_conversion();
+      break;
+    case STATE_CONVERT_TC_A:
+
+      if (result == ADC_DONE)
+      {
+        adc_store(ADC_CHANNEL_TC_A, adc);
+        state = STATE_CONVERT_TC_B;
+        adc_select_channel(ADC_CHANNEL_TC_B);
+        adc_start_conversion();
+      }
+      break;
+    case STATE_CONVERT_TC_B:
+      if (result == ADC_DONE)
+      {
+        adc_store(ADC_CHANNEL_TC_B, adc);
+        //degrees only now, once per period, for the control loops and <DAT>
+        internal_temp = adc_temp(ADC_CHANNEL_INTERNAL_TEMP);
+        temp_A = adc_temp(ADC_CHANNEL_TC_A);
+        temp_B = adc_temp(ADC_CHANNEL_TC_B);
+        //recalculate PID outputs after getting new temp. readings from both sensors
+        if (!estop)
+        {
+          schedule_update(); //gains for the temperature we are at
+          if (autotune_running())
+          {
+            autotune_update(); //relay experiment drives the heaters instead
+          }
+          else if (mimo_enabled())
+          {
+            mimo_run(); //mean and gradient loops
+          }
+          else
+          {
+            ff_update(); //duty the model expects at the setpoint
+            pid_A.run();
+            pid_B.run();
+          }
+          apply_outputs();
+          TRACE(TRACE_PID_RUN);
+        }
+        //every period, so a broken thermocouple is found within one
+        state = STATE_BURNOUT_A;
+        adc_select_channel(ADC_CHANNEL_BURNOUT_A);
+        adc_start_conversion();
+      }
+      break;
+    case STATE_BURNOUT_A:
+      if (result == ADC_DONE)
+      {
+        adc_store(ADC_CHANNEL_BURNOUT_A, adc);
+        burnout_stop(ADC_ERR_BURNOUT_A, ht_A, temp_A, duty_A);
+        state = STATE_BURNOUT_B;
+        adc_select_channel(ADC_CHANNEL_BURNOUT_B);
+        adc_start_conversion();
+      }
+      break;
+    case STATE_BURNOUT_B:
+      if (result == ADC_DONE)
+      {
+        adc_store(ADC_CHANNEL_BURNOUT_B, adc);
+        burnout_stop(ADC_ERR_BURNOUT_B, ht_B, temp_B, duty_B);
+        state = STATE_ADC_IDLE;
+      }
+      break;
+    case STATE_ADC_IDLE:
+      if (t >= LOOP_PERIOD)
+      {
+        state = STATE_CONVERT_INTERNAL;
+        adc_select_channel(ADC_CHANNEL_INTERNAL_TEMP);
+        adc_start_conversion();
+      }
+      break;
     }
-    break;
   }
 
-  if (estop)
-  {
-    ht_A.shutdown();
-    ht_B.shutdown();
-  }
-  else
+  if (events & EV_FAULT)
   {
-    ht_A.set_duty(duty_A);
-    ht_B.set_duty(duty_B);
+    ht_A.sense();
+    ht_B.sense();
   }
 
-  ht_A.update(t);
-  ht_B.update(t);
+  if (events & EV_RX)
+  {
+    serial_rx();
 
-  leds_update(t);
+    if (rx_flag) //msg received
+    {
+      rx_flag = 0;
+      uint8_t was_stopped = estop;
 
-  serial_rx();
+      if (parse_rx())
+      { //msg was valid
+        TRACE(TRACE_PARSED);
+        comms_ok = 1;
+        last_rx = ms;        //restart the timeout
+        leds_rx_msg_blink(); //blink the COMM led
 
-  if (rx_flag) //msg received
-  {
-    rx_flag = 0;
-
-    if (parse_rx())
-    { //msg was valid
-      comms_ok = 1;
-      last_rx = ms;        //restart the timeout
-      leds_rx_msg_blink(); //blink the COMM led
-
-      //even if we received a <SET,XXX> message
-      //do not leave emergency stop if the system
-      //encountered an error
-      if (error)
-      {
-        estop = 1;
+        //even if we received a <SET,XXX> message
+        //do not leave emergency stop if the system
+        //encountered an error
+        if (error)
+        {
+          estop = 1;
+        }
+        check_estop();
+        if (was_stopped && !estop)
+        {
+          apply_outputs(); //e.g. <SET>: no need to wait for the next PID run
+        }
       }
     }
   }
 
+  if (!(events & EV_TICK))
+  {
+    return;
+  }
+
   //check for comms timeout
   if (comms_ok && (ms - last_rx) > COMMS_TIMEOUT)
   {
     comms_ok = 0;
     estop = 1; //stop heaters on comms lost
+    check_estop();
   }
 
   if (t >= LOOP_PERIOD)
@@ -179,12 +335,22 @@ void loop()
       reboot();
     }
     error = errchk();
+    if (error)
+    {
+      estop = 1;
+    }
+    last_period_start = ms; //restart the period
+    t = 0;
+    check_estop();
     serial_tx(); //transmit status 1Hz
     error_tx();
+    if (adc_get_health().resets != health_sent)
+    {
+      health_tx(); //only after the ADC link has acted up
+    }
     //blink LED fast for errors
     if (error)
     {
-      estop = 1;
       leds_set_errblink_mode(ERRBLINK_MODE_FAST);
     }
     //blink LED slow if connection lost
@@ -196,54 +362,74 @@ void loop()
     {
       leds_set_errblink_mode(ERRBLINK_MODE_OFF);
     }
-    last_period_start = ms; //restart the period
   }
+
+  ht_A.update(outputs_position());
+  ht_B.update(outputs_position());
+
+  leds_update(t);
 }
 
 #define COMMA() Serial.print(',') //save typing
 void serial_tx()
 {
-  Serial.print("<DAT,");
-  //sends status data as csv list
-  Serial.print(millis() / 1000.0); //uptime
-  COMMA();
-  Serial.print(goal_temp); //setpoint temperature for both heater/thermocouple pairs
-  COMMA();
+  //sends status data as csv list, fields in the order protocol.h gives
+  DatFrame dat;
+  dat.uptime = millis() / 1000.0;
+  dat.setpoint = goal_temp;
+  dat.temp_A = temp_A;
+  dat.temp_B = temp_B;
+  dat.internal = internal_temp;
+  dat.duty_A = ht_A.get_duty(); //heater output levels
+  dat.duty_B = ht_B.get_duty();
+  dat.Kp = Kp;
+  dat.Ki = Ki;
+  dat.Kd = Kd;
+  dat.gradient = mimo_gradient_setpoint();
 
-  //thermocouple temperatures
-  Serial.print(temp_A);
-  COMMA();
-  Serial.print(temp_B);
-  COMMA();
-  //internal temp. of ADC (cold-junction temp)
-  Serial.print(internal_temp);
-  COMMA();
+  Serial.print(F("<DAT"));
+#define DAT_FIELD(name, decimals) \
+  COMMA();                        \
+  Serial.print(dat.name, decimals);
+  PROTOCOL_DAT_FIELDS(DAT_FIELD)
+#undef DAT_FIELD
+  Serial.println('>'); //newline at end of packet
+}
 
-  //heater status and output levels
-  Serial.print(ht_A.get_duty());
-  COMMA();
-  Serial.print(ht_B.get_duty());
-  COMMA();
+bool errchk()
+{
+  return adc_get_errcode() || !ht_A.has_power() || !ht_B.has_power();
+}
 
-  //current PID gains
-  Serial.print(Kp, 5);
+void health_tx()
+{
+  const AdcHealth &h = adc_get_health();
+  Serial.print(F("<HLT,"));
+  Serial.print(h.timeouts);
   COMMA();
-  Serial.print(Ki, 5);
+  Serial.print(h.readback_errors);
   COMMA();
-  Serial.print(Kd, 5);
-  Serial.println('>'); //newline at end of packet
+  Serial.print(h.resets);
+  Serial.println('>');
+  health_sent = h.resets;
 }
 
-bool errchk()
+void memory_tx()
 {
-  return adc_get_errcode() || !ht_A.has_power() || !ht_B.has_power();
+  Serial.print(F("<MEM,"));
+  Serial.print(ram_static());
+  COMMA();
+  Serial.print(ram_free());
+  COMMA();
+  Serial.print(ram_free_min());
+  Serial.println('>');
 }
 
 void error_tx()
 {
   if (errchk())
   {
-    Serial.print("<ERR,");
+    Serial.print(F("<ERR,"));
     Serial.print(adc_get_errcode(), HEX);
     COMMA();
     if (!ht_A.has_power())
@@ -254,6 +440,6 @@ void error_tx()
     {
       Serial.print('B');
     }
-    Serial.println(">");
+    Serial.println(F(">"));
   }
 }
\ No newline at end of file
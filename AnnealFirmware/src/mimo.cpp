@@ -0,0 +1,111 @@
+#include "mimo.h"
+#include "storage.h"
+#include "AutoPID.h"
+#include <EEPROM.h>
+
+extern float goal_temp;
+extern float temp_A, temp_B, duty_A, duty_B;
+
+#define GRADIENT_OUTPUT_MAX 50 //% duty the gradient loop may shift between heaters
+
+float temp_mean, temp_gradient, out_mean, out_gradient;
+float goal_gradient;
+uint8_t mimo_on;
+
+AutoPID pid_mean(&temp_mean, &goal_temp, &out_mean, 0, 100, 0, 0, 0);
+AutoPID pid_gradient(&temp_gradient, &goal_gradient, &out_gradient, -GRADIENT_OUTPUT_MAX, GRADIENT_OUTPUT_MAX, 0, 0, 0);
+
+float coupling[2][2];  //K, degC per % [zone][heater]
+float decouple[2][2];  //heater duty per unit of loop output [heater][mean, gradient]
+
+bool mimo_set_coupling(float kAA, float kAB, float kBA, float kBB)
+{
+    //M = T*K, where T takes the zone temperatures to (mean, gradient)
+    float m00 = (kAA + kBA) / 2, m01 = (kAB + kBB) / 2;
+    float m10 = kAA - kBA, m11 = kAB - kBB;
+    float det = m00 * m11 - m01 * m10;
+    if (isnan(det) || fabs(det) < 1e-4)
+    {
+        return false;
+    }
+    //D = inv(M) * g: scaled by the average direct gain g, so one unit of
+    //loop output moves the mean or the gradient as far as one % of duty
+    //moves a zone on its own. The usual PID gains then carry over.
+    float g = (kAA + kBB) / 2;
+    decouple[0][0] = m11 / det * g;
+    decouple[0][1] = -m01 / det * g;
+    decouple[1][0] = -m10 / det * g;
+    decouple[1][1] = m00 / det * g;
+    coupling[0][0] = kAA;
+    coupling[0][1] = kAB;
+    coupling[1][0] = kBA;
+    coupling[1][1] = kBB;
+    return true;
+}
+
+void mimo_begin()
+{
+    float k[2][2];
+    EEPROM.get(EE_COUPLING, k);
+    if (!mimo_set_coupling(k[0][0], k[0][1], k[1][0], k[1][1]))
+    {
+        //nothing stored (or garbage): assume the heaters don't interact
+        mimo_set_coupling(1, 0, 0, 1);
+    }
+}
+
+void mimo_save()
+{
+    EEPROM.put(EE_COUPLING, coupling);
+}
+
+void mimo_set_gains(float Kp, float Ki, float Kd)
+{
+    pid_mean.setGainsBumpless(Kp, Ki, Kd);
+    pid_gradient.setGainsBumpless(Kp, Ki, Kd);
+}
+
+void mimo_enable(float gradient)
+{
+    goal_gradient = gradient;
+    if (!mimo_on)
+    {
+        //start the loops from scratch rather than from stale history
+        pid_mean.reset();
+        pid_gradient.reset();
+        mimo_on = 1;
+    }
+}
+
+void mimo_disable()
+{
+    mimo_on = 0;
+    goal_gradient = 0; //both zones track goal_temp
+}
+
+bool mimo_enabled()
+{
+    return mimo_on;
+}
+
+float mimo_gradient_setpoint()
+{
+    return goal_gradient;
+}
+
+void mimo_run()
+{
+    temp_mean = (temp_A + temp_B) / 2;
+    temp_gradient = temp_A - temp_B;
+    pid_mean.run();
+    pid_gradient.run();
+    duty_A = constrain(decouple[0][0] * out_mean + decouple[0][1] * out_gradient, 0, 100);
+    duty_B = constrain(decouple[1][0] * out_mean + decouple[1][1] * out_gradient, 0, 100);
+}
+
+void mimo_limit(float granted)
+{
+    //scaling both duties scales both loop outputs with them. the mean loop
+    //is the one asking for the power, so it is held at what it got
+    pid_mean.setOutputRange(0, granted < 1 ? out_mean * granted : 100);
+}
@@ -0,0 +1,51 @@
+#include "ram.h"
+
+#if defined(ANNEAL_SIM)
+//the host has no 2KB to run out of: nothing to measure
+uint16_t ram_static() { return 0; }
+uint16_t ram_free() { return 0; }
+uint16_t ram_free_min() { return 0; }
+#else
+//from the linker script and avr-libc's malloc
+extern uint8_t _end, __stack, __heap_start;
+extern uint8_t *__brkval;
+
+//runs from .init3, before .data and .bss are set up and before anything
+//is on the stack, so all of the free RAM can be painted. naked: the init
+//sections fall through into each other, there is nothing to return to
+void ram_paint() __attribute__((naked, used, section(".init3")));
+void ram_paint()
+{
+    for (uint8_t *p = &_end; p <= &__stack; p++)
+    {
+        *p = RAM_PAINT;
+    }
+}
+
+static uint8_t *heap_end()
+{
+    return __brkval ? __brkval : &__heap_start;
+}
+
+uint16_t ram_static()
+{
+    return &__heap_start - (uint8_t *)RAMSTART;
+}
+
+uint16_t ram_free()
+{
+    return (uint8_t *)SP - heap_end();
+}
+
+uint16_t ram_free_min()
+{
+    //up to the deepest byte the stack has overwritten (one that happened to
+    //be written with the paint value reads a byte or two high)
+    uint8_t *p = heap_end();
+    while (p <= &__stack && *p == RAM_PAINT)
+    {
+        p++;
+    }
+    return p - heap_end();
+}
+#endif
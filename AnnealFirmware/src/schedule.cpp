@@ -0,0 +1,118 @@
+#include "schedule.h"
+#include "storage.h"
+#include "mimo.h"
+#include "AutoPID.h"
+#include <EEPROM.h>
+
+extern float goal_temp, Kp, Ki, Kd;
+extern float temp_A, temp_B;
+extern AutoPID pid_A, pid_B;
+
+GainPoint schedule[SCHEDULE_MAX];
+uint8_t schedule_n, schedule_src;
+
+void schedule_begin()
+{
+    EEPROM.get(EE_SCHEDULE, schedule);
+    uint8_t n = EEPROM.read(EE_SCHEDULE_N);
+    uint8_t src = EEPROM.read(EE_SCHEDULE_SRC);
+    if (!schedule_enable(n, src))
+    {
+        schedule_n = 0; //erased or corrupted: fixed gains
+    }
+}
+
+void schedule_save()
+{
+    EEPROM.put(EE_SCHEDULE, schedule);
+    EEPROM.update(EE_SCHEDULE_N, schedule_n);
+    EEPROM.update(EE_SCHEDULE_SRC, schedule_src);
+}
+
+bool schedule_set_point(uint8_t n, float temp, float p, float i, float d)
+{
+    if (n >= SCHEDULE_MAX || isnan(temp) || isnan(p) || isnan(i) || isnan(d))
+    {
+        return false;
+    }
+    schedule[n] = {temp, p, i, d};
+    return true;
+}
+
+bool schedule_enable(uint8_t n, uint8_t source)
+{
+    if (n > SCHEDULE_MAX || source > SCHEDULE_BY_TEMP)
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < n; i++)
+    {
+        if (isnan(schedule[i].temp) || isnan(schedule[i].Kp) || isnan(schedule[i].Ki) || isnan(schedule[i].Kd))
+        {
+            return false; //a breakpoint that was never set
+        }
+    }
+    schedule_n = n;
+    schedule_src = source;
+    return true;
+}
+
+void schedule_disable()
+{
+    schedule_n = 0; //the gains stay where the schedule left them
+}
+
+bool schedule_enabled()
+{
+    return schedule_n;
+}
+
+//interpolates between the nearest breakpoints below and above temp
+static GainPoint gains_at(float temp)
+{
+    int8_t below = -1, above = -1;
+    for (uint8_t i = 0; i < schedule_n; i++)
+    {
+        if (schedule[i].temp <= temp && (below < 0 || schedule[i].temp > schedule[below].temp))
+        {
+            below = i;
+        }
+        if (schedule[i].temp >= temp && (above < 0 || schedule[i].temp < schedule[above].temp))
+        {
+            above = i;
+        }
+    }
+    if (below < 0 || above < 0 || below == above)
+    {
+        return schedule[below < 0 ? above : below]; //outside the table, or right on a breakpoint
+    }
+    const GainPoint &lo = schedule[below], &hi = schedule[above];
+    float f = (temp - lo.temp) / (hi.temp - lo.temp);
+    return {temp, lo.Kp + (hi.Kp - lo.Kp) * f, lo.Ki + (hi.Ki - lo.Ki) * f, lo.Kd + (hi.Kd - lo.Kd) * f};
+}
+
+void schedule_update()
+{
+    if (!schedule_n)
+    {
+        return;
+    }
+    GainPoint g;
+    if (schedule_src == SCHEDULE_BY_TEMP)
+    {
+        GainPoint a = gains_at(temp_A), b = gains_at(temp_B);
+        pid_A.setGainsBumpless(a.Kp, a.Ki, a.Kd);
+        pid_B.setGainsBumpless(b.Kp, b.Ki, b.Kd);
+        g = gains_at((temp_A + temp_B) / 2); //what the mean loop and DAT go by
+    }
+    else
+    {
+        g = gains_at(goal_temp);
+        pid_A.setGainsBumpless(g.Kp, g.Ki, g.Kd);
+        pid_B.setGainsBumpless(g.Kp, g.Ki, g.Kd);
+    }
+    mimo_set_gains(g.Kp, g.Ki, g.Kd);
+    Kp = g.Kp;
+    Ki = g.Ki;
+    Kd = g.Kd;
+}
@@ -1,5 +1,7 @@
 #include <thermocouple.h>
 #include <SPI.h>
+#include <EEPROM.h>
+#include "storage.h"
 
 #define SPI_MASTER_DUMMY 0xFF
 // Commands for the ADC
@@ -42,94 +44,167 @@
 #define REG_MASK_RESERVED 0x01
 
 uint8_t adc_errcode;
+AdcHealth health;
+uint8_t link_faults; //in a row, since the last conversion that checked out
 
-void write_register(uint8_t address, uint8_t value)
+//the ADS1120 takes SCLK up to ~6.6MHz, data changes on the rising edge
+//and is sampled on the falling one (CPOL=0, CPHA=1)
+#define ADS1120_SPI SPISettings(4000000, MSBFIRST, SPI_MODE1)
+
+#define CONFIG_REG_VALS        \
+    {                          \
+        0x0E, 0x00, 0x00, 0x02 \
+    }
+//[0] in+ is AIN0, in- is AIN1, gain=128 (max), internal PGAmp. enabled
+//[1] 20SPS (min for max accuracy), normal mode, single-shot conversion mode, internal temp off, no burnout
+//    detection (the burnout check slot turns it on for one conversion per thermocouple)
+//[2] internal 2.048V reference, 60Hz notch disabled (it caused read issues), lowside switch open, excitation sources off
+//[3] excitation sources off, MISO signal is also used to indicate DRDY (data ready) at conversion completion
+
+uint8_t shadow_regs[4]; //what the config registers hold, as far as we know
+
+void send_command(uint8_t command)
 {
-    SPI.transfer(CMD_WREG | (address << 2));
-    SPI.transfer(value);
+    SPI.beginTransaction(ADS1120_SPI);
+    SPI.transfer(command);
+    SPI.endTransaction();
 }
 
-uint8_t read_register(uint8_t address)
+//brings the config registers to vals, writing the span from the first to the
+//last register that differs from the shadow copy in one WREG burst
+void write_registers(const uint8_t *vals)
 {
-    SPI.transfer(CMD_RREG | (address << 2));
-    uint8_t data = SPI.transfer(SPI_MASTER_DUMMY);
-    return data;
+    int8_t first = -1, last = -1;
+    for (uint8_t i = 0; i <= 3; i++)
+    {
+        if (vals[i] != shadow_regs[i])
+        {
+            if (first < 0)
+            {
+                first = i;
+            }
+            last = i;
+        }
+    }
+    if (first < 0)
+    {
+        return; //already set up like that
+    }
+    SPI.beginTransaction(ADS1120_SPI);
+    SPI.transfer(CMD_WREG | (first << 2) | (last - first)); //rr = first register, nn = count - 1
+    for (int8_t i = first; i <= last; i++)
+    {
+        SPI.transfer(vals[i]);
+        shadow_regs[i] = vals[i];
+    }
+    SPI.endTransaction();
 }
 
-void send_command(uint8_t command)
+//reads all four config registers back in one RREG burst; false if any
+//differs from the shadow copy, which means the SPI link can't be trusted
+bool verify_registers()
 {
-    SPI.transfer(command);
+    uint8_t read_vals[4];
+    SPI.beginTransaction(ADS1120_SPI);
+    SPI.transfer(CMD_RREG | (CONFIG_REG0_ADDRESS << 2) | 3);
+    for (uint8_t i = 0; i <= 3; i++)
+    {
+        read_vals[i] = SPI.transfer(SPI_MASTER_DUMMY);
+    }
+    SPI.endTransaction();
+    bool ok = true;
+    for (uint8_t i = 0; i <= 3; i++)
+    {
+#ifdef TC_DEBUG
+        Serial.print(i);
+        Serial.print(F(":"));
+        Serial.println(read_vals[i], HEX);
+#endif
+        if (read_vals[i] != shadow_regs[i])
+        {
+            ok = false;
+#ifdef TC_DEBUG
+            Serial.print(i);
+            Serial.println(F(" INCORRECT"));
+#endif
+        }
+    }
+    return ok;
 }
 
-#define CONFIG_REG_VALS        \
-    {                          \
-        0x0E, 0x00, 0x00, 0x02 \
+//burnout check counts over the plain reading with each thermocouple intact
+//(<BCL>), 0 = not learned: shorts go unnoticed
+int16_t burnout_baseline[2];
+int32_t learn_sum[2]; //while learning the baselines
+uint8_t learn_count[2];
+bool learning, learn_failed;
+
+static void burnout_begin()
+{
+    EEPROM.get(EE_BURNOUT, burnout_baseline);
+    for (int16_t &b : burnout_baseline)
+    {
+        if (b <= 0 || b >= BURNOUT_OPEN_COUNTS)
+        {
+            b = 0; //erased EEPROM reads -1
+        }
     }
-//[0] in+ is AIN0, in- is AIN1, gain=128 (max), internal PGAmp. enabled
-//[1] 20SPS (min for max accuracy), normal mode, single-shot conversion mode, internal temp off, no burnout detection
-//[2] internal 2.048V reference, 60Hz notch disabled (it caused read issues), lowside switch open, excitation sources off
-//[3] excitation sources off, MISO signal is also used to indicate DRDY (data ready) at conversion completion
+}
 
 void adc_init()
 {
-    // pinMode(ADC_MOSI, OUTPUT);
-    // pinMode(ADC_MISO_DRDY, INPUT);
-    // pinMode(ADC_SCK, OUTPUT);
-
-    // Configure the SPI interface (CPOL=0, CPHA=1)
     SPI.begin(); //old Arduino.h had pin arguments to .begin(): (ADS1120_CLK_PIN, ADS1120_MISO_PIN, ADS1120_MOSI_PIN);
-    SPI.setDataMode(SPI_MODE1);
 
-    delay(5);
     send_command(CMD_RESET); //reset the ADC in case this has not been a hard power cycle of the Arduino 5V bus
     delay(100);              //wait for device to reboot
+    for (uint8_t i = 0; i <= 3; i++)
+    {
+        shadow_regs[i] = 0x00; //power-on defaults
+    }
 
     const uint8_t reg_vals[] = CONFIG_REG_VALS;
 #ifdef TC_DEBUG
-    Serial.println("ADC config registers");
+    Serial.println(F("ADC config registers"));
 #endif
-    for (uint8_t i = 0; i <= 3; i++)
+    write_registers(reg_vals);
+    //check that the registers are set as expected
+    //if not, this indicates a problem with the SPI communication
+    if (!verify_registers())
     {
-        //set bits in ADC config registers
-        write_register(i, reg_vals[i]);
-        delay(5);
-        //check that each register is set as expected
-        //if not, this indicates a problem with the SPI communication
-        uint8_t read_val = read_register(i);
-        delay(5);
-        if (read_val != reg_vals[i])
-        {
-            adc_errcode |= ADC_ERR_BAD_SPI;
-#ifdef TC_DEBUG
-            Serial.print(i);
-            Serial.println(" INCORRECT");
-#endif
-        }
-#ifdef TC_DEBUG
-        Serial.print(i);
-        Serial.print(":");
-        Serial.println(read_val, HEX);
-#endif
+        adc_errcode |= ADC_ERR_BAD_SPI; //until a conversion checks out
+        link_faults = ADC_LINK_RETRIES;
     }
+    burnout_begin();
 }
 
 uint8_t adc_channel;
 void adc_select_channel(uint8_t channel)
 {
+    uint8_t vals[4];
+    memcpy(vals, shadow_regs, sizeof(vals));
     switch (channel)
     {
     case ADC_CHANNEL_INTERNAL_TEMP:
-        write_register(CONFIG_REG1_ADDRESS, 0x02); //connect internal temperature sensor to ADC
+        vals[CONFIG_REG1_ADDRESS] = 0x02; //connect internal temperature sensor to ADC
         break;
     case ADC_CHANNEL_TC_A:
-        write_register(CONFIG_REG1_ADDRESS, 0x00); //disconnect internal temperature sensor from ADC
-        write_register(CONFIG_REG0_ADDRESS, 0x0E); //in+ is AIN0, in- is AIN1, gain=128 (max), internal PGAmp enabled
+        vals[CONFIG_REG0_ADDRESS] = 0x0E; //in+ is AIN0, in- is AIN1, gain=128 (max), internal PGAmp enabled
+        vals[CONFIG_REG1_ADDRESS] = 0x00; //disconnect internal temperature sensor from ADC
         break;
     case ADC_CHANNEL_TC_B:
-        write_register(CONFIG_REG1_ADDRESS, 0x00); //disconnect internal temperature sensor from ADC
-        write_register(CONFIG_REG0_ADDRESS, 0x5E); //in+ is AIN2, in- is AIN3, gain=128 (max), internal PGAmp enabled
+        vals[CONFIG_REG0_ADDRESS] = 0x5E; //in+ is AIN2, in- is AIN3, gain=128 (max), internal PGAmp enabled
+        vals[CONFIG_REG1_ADDRESS] = 0x00; //disconnect internal temperature sensor from ADC
+        break;
+    case ADC_CHANNEL_BURNOUT_A:
+        vals[CONFIG_REG0_ADDRESS] = 0x0C;                     //AIN0/AIN1 like TC A, gain=64 (BURNOUT_GAIN)
+        vals[CONFIG_REG1_ADDRESS] = REG_MASK_BURNOUT_SOURCES; //10uA into in+, out of in-
+        break;
+    case ADC_CHANNEL_BURNOUT_B:
+        vals[CONFIG_REG0_ADDRESS] = 0x5C;
+        vals[CONFIG_REG1_ADDRESS] = REG_MASK_BURNOUT_SOURCES;
         break;
     }
+    write_registers(vals); //only what changed, in one burst
     adc_channel = channel; //remember which channel we're on
 }
 
@@ -145,17 +220,6 @@ bool adc_is_conversion_ready()
 {
     //when the ADC has DRDYM=1 set in the config registers,
     //the MISO line goes LOW when a conversion is ready for reading.
-
-    //conversion should take 50ms from receiving START/SYNC
-    //if it takes longer, there's an issue
-    if ((millis() - conversion_start_time) > 250)
-    {
-#ifdef TC_DEBUG
-        Serial.println("ADC timed out waiting for conversion");
-#endif
-        adc_errcode |= (1 << ADC_ERR_BAD_SPI); //we probably lost the SPI bus
-        return true;                           //just to break out of the loop
-    }
     return !digitalRead(ADC_MISO_DRDY);
 }
 
@@ -164,8 +228,10 @@ int16_t adc_read_conversion()
     if (adc_is_conversion_ready())
     {
         //adc reading comes in as two bytes
+        SPI.beginTransaction(ADS1120_SPI);
         int16_t adcVal = SPI.transfer(SPI_MASTER_DUMMY);
         adcVal = (adcVal << 8) | SPI.transfer(SPI_MASTER_DUMMY);
+        SPI.endTransaction();
         return adcVal;
     }
     else
@@ -175,109 +241,275 @@ int16_t adc_read_conversion()
     }
 }
 
-float adc_to_internal_temp(int16_t adc)
+//counts a failed conversion, then resets the ADC and loads the config
+//registers again in place. no reboot delay as in adc_init: RESET takes ~60us
+void link_fault()
 {
-    float temp = (adc >> 2) * 0.03125; //temperature is a left-justified 14-bit value. LSB=0.03125degC
-    //we do not account for the possibility of ADC temperatures below 0degC here
-    if (temp < INTERNAL_MIN_TEMP || temp > TC_MAX_TEMP)
-    { //35-95degF ADC temperatures are reasonable room temperatures
-        adc_errcode |= ADC_ERR_INTERNAL_TEMP_WILD;
-        return 0;
+    if (++link_faults >= ADC_LINK_RETRIES)
+    {
+        adc_errcode |= ADC_ERR_BAD_SPI; //not a glitch any more
+    }
+    health.resets++;
+    send_command(CMD_RESET);
+    delayMicroseconds(100);
+    for (uint8_t i = 0; i <= 3; i++)
+    {
+        shadow_regs[i] = 0x00; //power-on defaults
+    }
+    const uint8_t reg_vals[] = CONFIG_REG_VALS;
+    write_registers(reg_vals);
+}
+
+uint8_t adc_poll(int16_t &adc)
+{
+    //conversion should take 50ms from receiving START/SYNC
+    //if it takes longer, there's an issue
+    if ((millis() - conversion_start_time) > ADC_TIMEOUT)
+    {
+#ifdef TC_DEBUG
+        Serial.println(F("ADC timed out waiting for conversion"));
+#endif
+        health.timeouts++;
+        link_fault(); //we probably lost the SPI bus
+        return ADC_FAULT;
+    }
+    if (!adc_is_conversion_ready())
+    {
+        return ADC_BUSY;
+    }
+    adc = adc_read_conversion();
+    //the reading only counts if it was taken with the settings we made
+    if (!verify_registers())
+    {
+        health.readback_errors++;
+        link_fault();
+        return ADC_FAULT;
+    }
+    link_faults = 0;
+    adc_errcode &= ~ADC_ERR_BAD_SPI;
+    return ADC_DONE;
+}
+
+const AdcHealth &adc_get_health()
+{
+    return health;
+}
+
+//from the datasheet, the LSB=2*Vref/gain/2^16, where Vref=2.048V and gain=128
+#define TC_UV_PER_COUNT 0.48828125
+//internal temperature is a left-justified 14-bit value. LSB=0.03125degC
+#define INTERNAL_COUNTS_PER_DEG 32
+//the burnout check's LSB, and what the 10uA sources lose across
+//TC_SHORT_DROP_OHMS of thermocouple, in those counts
+#define BURNOUT_UA 10
+#define BURNOUT_UV_PER_COUNT (TC_UV_PER_COUNT * 128 / BURNOUT_GAIN)
+#define TC_SHORT_DROP_COUNTS (int16_t)(BURNOUT_UA * TC_SHORT_DROP_OHMS / BURNOUT_UV_PER_COUNT)
+
+//ITS-90 coefficients for type T, lowest power first. In flash: RAM is
+//scarcer than the cycles pgm_read_float() costs
+static const float emf_coeffs[] PROGMEM = {0, 3.8748106364E+01, 3.3292227880E-02, 2.0618243404E-04, -2.1882256846E-06,
+                                           1.0996880928E-08, -3.0815758772E-11, 4.5479135290E-14, -2.7512901673E-17};
+//inverse, negative temps have one polynomial fit
+static const float inverse_neg_coeffs[] PROGMEM = {0, 2.5949192E-02, -2.1316967E-07, 7.9018692E-10, 4.2527777E-13,
+                                                   1.3304473E-16, 2.0241446E-20, 1.2668171E-24};
+//positive temps have another
+static const float inverse_pos_coeffs[] PROGMEM = {0, 2.592800E-02, -7.602961E-07, 4.637791E-11, -2.165394E-15,
+                                                   6.048144E-20, -7.293422E-25};
+
+//Horner's rule: one multiply and add per term instead of a pow() each
+static float polynomial(const float *c, uint8_t n, float x)
+{
+    float y = pgm_read_float(&c[n - 1]);
+    for (int8_t i = n - 2; i >= 0; i--)
+    {
+        y = y * x + pgm_read_float(&c[i]);
+    }
+    return y;
+}
+
+//voltage theoretically developed by a thermocouple at temp if it were
+//referenced to 0degC
+static float type_t_uV(float temp)
+{
+    return polynomial(emf_coeffs, sizeof(emf_coeffs) / sizeof(float), temp);
+}
+
+//temperature of a thermocouple developing std_uV referenced to 0degC
+static float type_t_temp(float std_uV)
+{
+    if (std_uV <= 0)
+    {
+        return polynomial(inverse_neg_coeffs, sizeof(inverse_neg_coeffs) / sizeof(float), std_uV);
     }
     else
     {
-        adc_errcode &= ~ADC_ERR_INTERNAL_TEMP_WILD;
-        return temp;
+        return polynomial(inverse_pos_coeffs, sizeof(inverse_pos_coeffs) / sizeof(float), std_uV);
     }
 }
 
-float adc_to_thermocouple_temp(int16_t adc, float internal_temp)
+//the fits are monotonic over everything the ADC can read, so the
+//temperature bounds turn into EMF bounds once and for all
+static float uV_where_fit_reads(float temp)
 {
-    //from the datasheet, the LSB=2*Vref/gain/2^16, where Vref=2.048V and gain=128
-    //calculate the thermocouple probe reading, in microvolts
-    float tc_uV = adc * 0.48828125;
-
-    //calculate the voltage theoretically developed by a thermocouple
-    //at the current reference temp (amp internal temp),
-    //if it were referenced to 0degC.
-    //uses ITS-90 coefficients for type T
-    float ref_uV = 3.8748106364E+01 * internal_temp +
-                   3.3292227880E-02 * pow(internal_temp, 2.0) +
-                   2.0618243404E-04 * pow(internal_temp, 3.0) +
-                   -2.1882256846E-06 * pow(internal_temp, 4.0) +
-                   1.0996880928E-08 * pow(internal_temp, 5.0) +
-                   -3.0815758772E-11 * pow(internal_temp, 6.0) +
-                   4.5479135290E-14 * pow(internal_temp, 7.0) +
-                   -2.7512901673E-17 * pow(internal_temp, 8.0);
-
-    //calculate voltage theoretically developed by a thermocouple at our external
-    //temp, but referenced to 0degC
-    float std_tc_uV = tc_uV + ref_uV;
-
-    //use the inverse ITS-90 coefficients for type T to get a temperature out
-    float external_temp;
-    if (std_tc_uV <= 0)
-    { //negative temps have one polynomial fit
-        external_temp = 2.5949192E-02 * std_tc_uV +
-                        -2.1316967E-07 * pow(std_tc_uV, 2.0) +
-                        7.9018692E-10 * pow(std_tc_uV, 3.0) +
-                        4.2527777E-13 * pow(std_tc_uV, 4.0) +
-                        1.3304473E-16 * pow(std_tc_uV, 5.0) +
-                        2.0241446E-20 * pow(std_tc_uV, 6.0) +
-                        1.2668171E-24 * pow(std_tc_uV, 7.0);
+    float lo = -16000, hi = 16000; //full scale is +-16mV
+    for (uint8_t i = 0; i < 24; i++)
+    {
+        float mid = (lo + hi) / 2;
+        (type_t_temp(mid) < temp ? lo : hi) = mid;
+    }
+    return (lo + hi) / 2;
+}
+
+//samples stay ADC counts until a temperature is asked for. Range checks
+//compare counts against limits worked out whenever the cold junction moves,
+//so a conversion costs no float maths on its way in
+int16_t samples[ADC_CHANNEL_TC_B + 1]; //by channel
+int16_t cj_counts = INT16_MIN;         //14-bit cold junction the limits below are for
+float cj_uV;                           //type T EMF at the cold junction, referenced to 0degC
+int16_t tc_min_counts, tc_max_counts;  //thermocouple readings outside these are wild
+//0degC-referenced EMF the inverse fit puts at the ends of the thermocouple range
+float wild_min_uV = uV_where_fit_reads(TC_MIN_TEMP);
+float wild_max_uV = uV_where_fit_reads(TC_MAX_TEMP);
+
+static void set_cold_junction(int16_t cj)
+{
+    if (cj == cj_counts)
+    {
+        return;
+    }
+    cj_counts = cj;
+    cj_uV = type_t_uV((float)cj / INTERNAL_COUNTS_PER_DEG);
+    //a thermocouple reading is wild when it and the cold junction together
+    //fall outside the EMF bounds
+    tc_min_counts = ceil((wild_min_uV - cj_uV) / TC_UV_PER_COUNT);
+    tc_max_counts = floor((wild_max_uV - cj_uV) / TC_UV_PER_COUNT);
+}
+
+static void flag(uint8_t err, bool wild)
+{
+    if (wild)
+    {
+        adc_errcode |= err;
     }
     else
-    { //positive temps have another
-        external_temp = 2.592800E-02 * std_tc_uV +
-                        -7.602961E-07 * pow(std_tc_uV, 2.0) +
-                        4.637791E-11 * pow(std_tc_uV, 3.0) +
-                        -2.165394E-15 * pow(std_tc_uV, 4.0) +
-                        6.048144E-20 * pow(std_tc_uV, 5.0) +
-                        -7.293422E-25 * pow(std_tc_uV, 6.0);
+    {
+        adc_errcode &= ~err;
     }
-#ifdef TC_DEBUG
-    Serial.println("Start TC calc");
-    Serial.print("TC ADC reading: ");
-    Serial.println(adc);
-    Serial.print("TC uV: ");
-    Serial.println(tc_uV);
-    Serial.print("Internal temp: ");
-    Serial.println(internal_temp);
-    Serial.print("ref uV: ");
-    Serial.println(ref_uV);
-    Serial.print("std ref uV: ");
-    Serial.println(std_tc_uV);
-    Serial.print("corrected temp:");
-    Serial.println(external_temp);
-    Serial.println("End TC calc");
-#endif
-    if (external_temp < TC_MIN_TEMP || external_temp > TC_MAX_TEMP)
+}
+
+void adc_burnout_learn()
+{
+    learning = true;
+    learn_failed = false;
+    for (uint8_t zone = 0; zone < 2; zone++)
     {
-        //just above absolute zero to a hot room temperature is reasonable for the cryogenic apparatus
-        if (adc_channel == ADC_CHANNEL_TC_A)
-        {
-            adc_errcode |= ADC_ERR_TEMP_A_WILD;
-        }
-        else if (adc_channel == ADC_CHANNEL_TC_B)
+        learn_sum[zone] = 0;
+        learn_count[zone] = 0;
+    }
+}
+
+//takes one check into the baseline being learned, and once both channels
+//have had enough, stores and reports the result
+static void burnout_learn(uint8_t zone, bool open, int32_t rise)
+{
+    learn_failed |= open;
+    if (learn_count[zone] < BURNOUT_LEARN_CHECKS)
+    {
+        learn_sum[zone] += rise;
+        learn_count[zone]++;
+    }
+    if (learn_count[0] < BURNOUT_LEARN_CHECKS || learn_count[1] < BURNOUT_LEARN_CHECKS)
+    {
+        return;
+    }
+    learning = false;
+    if (learn_failed)
+    {
+        Serial.println(F("<BCL,FAIL>"));
+        return;
+    }
+    Serial.print(F("<BCL,OK"));
+    for (uint8_t z = 0; z < 2; z++)
+    {
+        burnout_baseline[z] = learn_sum[z] / BURNOUT_LEARN_CHECKS;
+        Serial.print(',');
+        Serial.print(burnout_baseline[z] * BURNOUT_UV_PER_COUNT / BURNOUT_UA, 1);
+    }
+    Serial.println('>');
+    EEPROM.put(EE_BURNOUT, burnout_baseline);
+}
+
+void adc_store(uint8_t channel, int16_t adc)
+{
+    if (channel > ADC_CHANNEL_TC_B)
+    {
+        //burnout check: what the current sources added to the plain reading
+        uint8_t zone = channel == ADC_CHANNEL_BURNOUT_A ? 0 : 1;
+        bool open = adc >= BURNOUT_OPEN_COUNTS;
+        //the plain reading, taken at gain 128, in the check's counts
+        int16_t plain = samples[zone ? ADC_CHANNEL_TC_B : ADC_CHANNEL_TC_A] / (128 / BURNOUT_GAIN);
+        int32_t rise = (int32_t)adc - plain;
+        bool shorted = !open && burnout_baseline[zone] && rise < burnout_baseline[zone] - TC_SHORT_DROP_COUNTS;
+        flag(zone ? ADC_ERR_OPEN_B : ADC_ERR_OPEN_A, open);
+        flag(zone ? ADC_ERR_SHORT_B : ADC_ERR_SHORT_A, shorted);
+        if (learning)
         {
-            adc_errcode |= ADC_ERR_TEMP_B_WILD;
+            burnout_learn(zone, open, rise);
         }
-        return 0;
+        return; //not a sample, nothing to convert later
+    }
+    samples[channel] = adc;
+    if (channel == ADC_CHANNEL_INTERNAL_TEMP)
+    {
+        //we do not account for the possibility of ADC temperatures below 0degC here
+        int16_t cj = adc >> 2;
+        //35-95degF ADC temperatures are reasonable room temperatures
+        bool wild = cj < INTERNAL_MIN_TEMP * INTERNAL_COUNTS_PER_DEG || cj > TC_MAX_TEMP * INTERNAL_COUNTS_PER_DEG;
+        flag(ADC_ERR_INTERNAL_TEMP_WILD, wild);
+        //without a believable cold junction the thermocouples are referenced to 0degC
+        set_cold_junction(wild ? 0 : cj);
     }
     else
     {
-        if (adc_channel == ADC_CHANNEL_TC_A)
-        {
-            adc_errcode &= ~ADC_ERR_TEMP_A_WILD;
-        }
-        else if (adc_channel == ADC_CHANNEL_TC_B)
-        {
-            adc_errcode &= ~ADC_ERR_TEMP_B_WILD;
-        }
-        return external_temp;
+        //just above absolute zero to a hot room temperature is reasonable for the cryogenic apparatus
+        bool wild = adc < tc_min_counts || adc > tc_max_counts;
+        flag(channel == ADC_CHANNEL_TC_A ? ADC_ERR_TEMP_A_WILD : ADC_ERR_TEMP_B_WILD, wild);
     }
 }
 
+float adc_temp(uint8_t channel)
+{
+    int16_t adc = samples[channel];
+    if (channel == ADC_CHANNEL_INTERNAL_TEMP)
+    {
+        return (adc_errcode & ADC_ERR_INTERNAL_TEMP_WILD) ? 0 : (float)cj_counts / INTERNAL_COUNTS_PER_DEG;
+    }
+    uint8_t bad = channel == ADC_CHANNEL_TC_A ? ADC_ERR_TEMP_A_WILD | ADC_ERR_BURNOUT_A : ADC_ERR_TEMP_B_WILD | ADC_ERR_BURNOUT_B;
+    if (adc_errcode & bad)
+    {
+        return 0;
+    }
+    //calculate the thermocouple probe reading, in microvolts, and add what a
+    //thermocouple at the cold junction would develop to reference it to 0degC
+    float std_tc_uV = adc * TC_UV_PER_COUNT + cj_uV;
+    float external_temp = type_t_temp(std_tc_uV);
+#ifdef TC_DEBUG
+    Serial.println(F("Start TC calc"));
+    Serial.print(F("TC ADC reading: "));
+    Serial.println(adc);
+    Serial.print(F("Cold junction counts: "));
+    Serial.println(cj_counts);
+    Serial.print(F("ref uV: "));
+    Serial.println(cj_uV);
+    Serial.print(F("std ref uV: "));
+    Serial.println(std_tc_uV);
+    Serial.print(F("corrected temp:"));
+    Serial.println(external_temp);
+    Serial.println(F("End TC calc"));
+#endif
+    return external_temp;
+}
+
 uint8_t adc_get_errcode()
 {
     return adc_errcode;
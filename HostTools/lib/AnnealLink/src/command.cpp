@@ -0,0 +1,160 @@
+#include "command.h"
+#include "frame.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+//shortest text that reads back as the same float, so long argument lists
+//still fit the firmware's buffer
+static std::string number(float v)
+{
+    char buf[32];
+    for (int digits = 6; digits <= 9; digits++)
+    {
+        snprintf(buf, sizeof(buf), "%.*g", digits, v);
+        if (strtof(buf, NULL) == v)
+        {
+            break;
+        }
+    }
+    return buf;
+}
+
+std::string encode_command(uint8_t id, const std::vector<float> &args, int32_t seq)
+{
+    if (id >= PROTO_UNKNOWN || args.size() > PROTO_MAX_ARGS || !proto_argc_ok(id, args.size()))
+    {
+        return std::string();
+    }
+    std::string frame = std::string("<") + proto_tag(id);
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        frame += ',';
+        if (proto_is_zone_arg(id, i))
+        {
+            if (args[i] != 0 && args[i] != 1)
+            {
+                return std::string();
+            }
+            frame += args[i] ? 'B' : 'A';
+        }
+        else
+        {
+            frame += number(args[i]);
+        }
+    }
+    if (seq != PROTO_NO_SEQ)
+    {
+        frame += ",#" + std::to_string(seq);
+    }
+    frame += '>';
+    return frame_is_command(frame) && seq <= PROTO_SEQ_MAX ? frame : std::string();
+}
+
+bool decode_command(const std::string &frame, Command &cmd)
+{
+    if (!frame_is_command(frame))
+    {
+        return false;
+    }
+    //the same decoder the firmware runs, on a copy like its receive buffer
+    char text[ANNEAL_RXBUF_LEN];
+    frame.copy(text, frame.size() - 2, 1);
+    text[frame.size() - 2] = '\0';
+    return proto_decode(text, cmd);
+}
+
+static bool is_reply(const std::string &frame)
+{
+    std::string tag = frame_tag(frame);
+    return tag == "ACK" || tag == "NAK";
+}
+
+bool parse_reply(const std::string &frame, Reply &reply)
+{
+    if (!is_reply(frame))
+    {
+        return false;
+    }
+    std::vector<std::string> f;
+    size_t pos = 4;
+    while (pos < frame.size() - 1 && frame[pos] == ',')
+    {
+        size_t end = frame.find_first_of(",>", pos + 1);
+        f.push_back(frame.substr(pos + 1, end - pos - 1));
+        pos = end;
+    }
+    char *end;
+    unsigned long seq = f.empty() ? 0 : strtoul(f[0].c_str(), &end, 10);
+    if (f.size() < 2 || f[0].empty() || *end || seq > PROTO_SEQ_MAX)
+    {
+        return false;
+    }
+    reply.ack = frame_tag(frame) == "ACK";
+    reply.seq = seq;
+    reply.tag.clear();
+    reply.values.clear();
+    reply.code = 0;
+    if (!reply.ack)
+    {
+        reply.code = strtoul(f[1].c_str(), &end, 10);
+        return f.size() == 2 && *end == '\0';
+    }
+    reply.tag = f[1];
+    for (size_t i = 2; i < f.size(); i++)
+    {
+        reply.values.push_back(strtof(f[i].c_str(), &end));
+        if (f[i].empty() || *end)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//where the digits of the sequence number are: first field of a reply,
+//",#n" at the end of a command
+static bool seq_span(const std::string &frame, size_t &begin, size_t &end)
+{
+    if (is_reply(frame))
+    {
+        begin = 5;
+        end = frame.find_first_of(",>", begin);
+    }
+    else
+    {
+        size_t comma = frame.rfind(',');
+        if (comma == std::string::npos || comma + 1 >= frame.size() || frame[comma + 1] != '#')
+        {
+            return false;
+        }
+        begin = comma + 2;
+        end = frame.size() - 1;
+    }
+    return end != std::string::npos && end > begin && frame.find_first_not_of("0123456789", begin) == end;
+}
+
+bool frame_seq(const std::string &frame, uint16_t &seq)
+{
+    size_t begin, end;
+    if (!seq_span(frame, begin, end))
+    {
+        return false;
+    }
+    unsigned long n = strtoul(frame.c_str() + begin, NULL, 10);
+    if (n > PROTO_SEQ_MAX)
+    {
+        return false;
+    }
+    seq = n;
+    return true;
+}
+
+std::string frame_with_seq(const std::string &frame, uint16_t seq)
+{
+    size_t begin, end;
+    if (!seq_span(frame, begin, end))
+    {
+        return frame;
+    }
+    return frame.substr(0, begin) + std::to_string(seq) + frame.substr(end);
+}
@@ -0,0 +1,32 @@
+#pragma once
+//Commands for the controller, encoded and decoded by the table in the
+//firmware's protocol.h: a command this builds is one the firmware accepts.
+#include "protocol.h"
+#include <string>
+#include <vector>
+
+//"<SET,-200>" for PROTO_SET, {-200}; zone arguments are given as 0 (A) or 1 (B).
+//With a sequence number the firmware answers at once: "<SET,-200,#17>".
+//Empty if the arguments don't fit the command or the frame wouldn't fit the
+//firmware's receive buffer.
+std::string encode_command(uint8_t id, const std::vector<float> &args = {}, int32_t seq = PROTO_NO_SEQ);
+
+//the command in frame, false unless the firmware would accept it
+//(cmd.tag is not valid afterwards)
+bool decode_command(const std::string &frame, Command &cmd);
+
+//<ACK,seq,TAG,applied value...> or <NAK,seq,code>
+struct Reply
+{
+    bool ack;
+    uint16_t seq;
+    std::string tag;           //ACK only
+    std::vector<float> values; //ACK only, for commands that set something
+    uint8_t code;              //NAK only, PROTO_NAK_*
+};
+bool parse_reply(const std::string &frame, Reply &reply);
+
+//sequence number of a command or reply frame, false if it has none
+bool frame_seq(const std::string &frame, uint16_t &seq);
+//the same frame with another sequence number (it must have one already)
+std::string frame_with_seq(const std::string &frame, uint16_t seq);
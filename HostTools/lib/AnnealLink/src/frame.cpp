@@ -0,0 +1,69 @@
+#include "frame.h"
+#include <ctype.h>
+
+void LineSplitter::feed(const char *data, size_t len)
+{
+    buf.append(data, len);
+}
+
+bool LineSplitter::next(std::string &line)
+{
+    size_t nl = buf.find('\n');
+    if (nl == std::string::npos)
+    {
+        return false;
+    }
+    size_t end = nl;
+    if (end > 0 && buf[end - 1] == '\r')
+    {
+        end--;
+    }
+    line.assign(buf, 0, end);
+    buf.erase(0, nl + 1);
+    return true;
+}
+
+std::vector<std::string> frames_in(const std::string &text)
+{
+    std::vector<std::string> frames;
+    size_t pos = 0;
+    while ((pos = text.find('<', pos)) != std::string::npos)
+    {
+        size_t end = text.find('>', pos);
+        if (end == std::string::npos)
+        {
+            break;
+        }
+        size_t restart = text.rfind('<', end);
+        frames.push_back(text.substr(restart, end - restart + 1));
+        pos = end + 1;
+    }
+    return frames;
+}
+
+std::string frame_tag(const std::string &frame)
+{
+    if (frame.size() < 5 || frame.front() != '<' || frame.back() != '>')
+    {
+        return std::string();
+    }
+    size_t end = frame.find_first_of(",>", 1);
+    if (end != 4)
+    {
+        return std::string();
+    }
+    for (size_t i = 1; i < 4; i++)
+    {
+        if (!isupper((unsigned char)frame[i]))
+        {
+            return std::string();
+        }
+    }
+    return frame.substr(1, 3);
+}
+
+bool frame_is_command(const std::string &frame)
+{
+    //payload between the markers plus the firmware's null terminator must fit
+    return !frame_tag(frame).empty() && frame.size() - 2 < ANNEAL_RXBUF_LEN;
+}
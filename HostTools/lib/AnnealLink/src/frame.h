@@ -0,0 +1,35 @@
+#pragma once
+//Framing of the controller's serial protocol: every packet is <CMD,field,...>
+//and the firmware ends each of its packets with CR LF
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+//firmware receive buffer (RXBUF_LEN in comms.h), including the terminator
+#define ANNEAL_RXBUF_LEN 64
+//bytes of numbered commands that may be on their way to the firmware without
+//an answer yet: all of them could still sit in its 64 byte receive ring, and
+//the rest of the ring is left for unnumbered ones like the gateway's <NOP>
+#define ANNEAL_RX_WINDOW 48
+
+//accumulates a byte stream and hands back complete lines, without CR/LF
+class LineSplitter
+{
+public:
+    void feed(const char *data, size_t len);
+    bool next(std::string &line);
+    size_t pending() const { return buf.size(); }
+    void clear() { buf.clear(); }
+
+private:
+    std::string buf;
+};
+
+//pulls every complete <...> frame out of text, in order
+std::vector<std::string> frames_in(const std::string &text);
+
+//true if frame is <XXX...> with a three-letter command that fits the firmware's buffer
+bool frame_is_command(const std::string &frame);
+
+//"DAT" for "<DAT,1.0,...>", empty if frame is malformed
+std::string frame_tag(const std::string &frame);
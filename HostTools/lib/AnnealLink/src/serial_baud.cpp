@@ -0,0 +1,19 @@
+//kept apart from serial_port.cpp: <asm/termbits.h> clashes with <termios.h>
+#include "serial_port.h"
+#include <asm/ioctls.h>
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+
+bool serial_set_baud(int fd, uint32_t baud)
+{
+    struct termios2 tio;
+    if (ioctl(fd, TCGETS2, &tio))
+    {
+        return false;
+    }
+    tio.c_cflag &= ~CBAUD;
+    tio.c_cflag |= BOTHER;
+    tio.c_ispeed = baud;
+    tio.c_ospeed = baud;
+    return ioctl(fd, TCSETS2, &tio) == 0;
+}
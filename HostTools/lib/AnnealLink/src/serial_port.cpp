@@ -0,0 +1,52 @@
+#include "serial_port.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <termios.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+static bool is_pty(int fd)
+{
+    //unix98 pseudo-terminal slaves have majors 136-143
+    struct stat st;
+    return fstat(fd, &st) == 0 && major(st.st_rdev) >= 136 && major(st.st_rdev) <= 143;
+}
+
+int serial_open(const char *path, uint32_t baud, std::string &err)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        err = std::string(path) + ": " + strerror(errno);
+        return -1;
+    }
+    termios tio;
+    if (tcgetattr(fd, &tio))
+    {
+        err = std::string(path) + ": not a terminal: " + strerror(errno);
+        close(fd);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tio.c_cc[VMIN] = 1; //with O_NONBLOCK: EAGAIN when empty, 0 only at hangup
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tio))
+    {
+        err = std::string(path) + ": " + strerror(errno);
+        close(fd);
+        return -1;
+    }
+    if (!serial_set_baud(fd, baud) && !is_pty(fd))
+    {
+        err = std::string(path) + ": cannot set " + std::to_string(baud) + " baud";
+        close(fd);
+        return -1;
+    }
+    //the UNO resets when the port opens; drop any half-sent frame from before
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
@@ -0,0 +1,15 @@
+#pragma once
+//Raw 8N1 access to the controller's serial port (USB adaptor or pseudo-terminal)
+#include <stdint.h>
+#include <string>
+
+//the firmware runs its UART at 250kbit/s
+#define ANNEAL_BAUD 250000
+
+//opens path non-blocking in raw mode and discards anything already buffered.
+//returns the fd, or -1 with a message in err
+int serial_open(const char *path, uint32_t baud, std::string &err);
+
+//sets an arbitrary bit rate (250000 isn't one of the Bxxx constants).
+//pseudo-terminals ignore the rate, so failing on one is not an error
+bool serial_set_baud(int fd, uint32_t baud);
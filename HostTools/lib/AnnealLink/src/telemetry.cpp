@@ -0,0 +1,92 @@
+#include "telemetry.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+//splits "<TAG,a,b,c>" into {"a","b","c"}
+static bool fields_of(const std::string &frame, const char *tag, std::vector<std::string> &fields)
+{
+    size_t taglen = strlen(tag);
+    if (frame.size() < taglen + 2 || frame.front() != '<' || frame.back() != '>' ||
+        frame.compare(1, taglen, tag) != 0)
+    {
+        return false;
+    }
+    fields.clear();
+    size_t pos = 1 + taglen;
+    while (pos < frame.size() - 1 && frame[pos] == ',')
+    {
+        size_t end = frame.find_first_of(",>", pos + 1);
+        fields.push_back(frame.substr(pos + 1, end - pos - 1));
+        pos = end;
+    }
+    return pos == frame.size() - 1;
+}
+
+static bool to_float(const std::string &s, float &out)
+{
+    char *end;
+    out = strtof(s.c_str(), &end); //also takes the firmware's "nan"/"inf"
+    return !s.empty() && *end == '\0';
+}
+
+bool parse_dat(const std::string &frame, DatFrame &dat)
+{
+    std::vector<std::string> f;
+    //newer firmware may append fields; the ones we know keep their meaning
+    if (!fields_of(frame, "DAT", f) || f.size() < PROTO_DAT_MIN_FIELDS)
+    {
+        return false;
+    }
+    float *dst[] = {
+#define DAT_FIELD(name, decimals) &dat.name,
+        PROTOCOL_DAT_FIELDS(DAT_FIELD)
+#undef DAT_FIELD
+    };
+    for (size_t i = 0; i < PROTO_DAT_FIELDS; i++)
+    {
+        if (i >= f.size() || !to_float(f[i], *dst[i]))
+        {
+            if (i < PROTO_DAT_MIN_FIELDS)
+            {
+                return false;
+            }
+            *dst[i] = NAN; //missing from older firmware
+        }
+    }
+    return true;
+}
+
+bool parse_err(const std::string &frame, ErrFrame &err)
+{
+    std::vector<std::string> f;
+    if (!fields_of(frame, "ERR", f) || f.size() != 2)
+    {
+        return false;
+    }
+    char *end;
+    unsigned long code = strtoul(f[0].c_str(), &end, 16);
+    if (f[0].empty() || *end != '\0' || code > 0xFF)
+    {
+        return false;
+    }
+    err.adc_err = code;
+    err.fuses = 0;
+    for (char c : f[1])
+    {
+        if (c == 'A')
+        {
+            err.fuses |= FUSE_A_BLOWN;
+        }
+        else if (c == 'B')
+        {
+            err.fuses |= FUSE_B_BLOWN;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+//Decoding of the packets the firmware sends on its own:
+//<DAT,uptime,setpoint,temp_A,temp_B,internal,duty_A,duty_B,Kp,Ki,Kd,gradient>
+//<ERR,adc errcode (hex),fuses blown (A|B)>
+//DatFrame and the field order come from the firmware's protocol.h
+#include "protocol.h"
+#include <stdint.h>
+#include <string>
+
+#define FUSE_A_BLOWN 0x01
+#define FUSE_B_BLOWN 0x02
+
+struct ErrFrame
+{
+    uint8_t adc_err; //ADC_ERR_* bits
+    uint8_t fuses;   //FUSE_*_BLOWN bits
+};
+
+//gradient is NAN from firmware without <GRD>
+bool parse_dat(const std::string &frame, DatFrame &dat);
+bool parse_err(const std::string &frame, ErrFrame &err);
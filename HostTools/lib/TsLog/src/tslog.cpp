@@ -0,0 +1,682 @@
+#include "tslog.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TSLOG_MAGIC "ANNLOG\r\n" //the CR LF catches text-mode mangling
+#define TSLOG_VERSION 2 //1: no gradient column
+#define TSLOG_HEADER_BYTES 4096
+#define TSLOG_ROWS_PER_BLOCK 4096
+#define TSLOG_COLUMN_ALIGN 64
+
+struct TsColumnDesc
+{
+    char name[16];
+    uint32_t width;  //bytes per value
+    uint32_t offset; //from the start of the block
+};
+
+struct TsFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_bytes;
+    uint32_t block_bytes;
+    uint32_t rows_per_block;
+    uint64_t nblocks; //blocks in the file; only the last can be partly filled
+    uint32_t ncols;
+    uint32_t reserved;
+    TsColumnDesc cols[TSCOL_COUNT];
+};
+static_assert(sizeof(TsFileHeader) <= TSLOG_HEADER_BYTES, "file header must fit its page");
+
+struct TsBlockHeader
+{
+    int64_t t_first, t_last;
+    uint32_t nrows; //committed rows; written last, after the row's columns
+    uint32_t nerr;
+    uint32_t run_first, run_last;
+    uint8_t reserved[32];
+};
+static_assert(sizeof(TsBlockHeader) == 64, "block header layout is part of the file format");
+
+struct ColumnSpec
+{
+    const char *name;
+    uint32_t width;
+    size_t row_offset;
+    char type; //'i' signed, 'u' unsigned, 'f' float
+};
+
+static const ColumnSpec COLUMNS[TSCOL_COUNT] = {
+    {"t", 8, offsetof(TsRow, t_us), 'i'},
+    {"run", 4, offsetof(TsRow, run), 'u'},
+    {"kind", 1, offsetof(TsRow, kind), 'u'},
+    {"uptime", 4, offsetof(TsRow, uptime), 'f'},
+    {"setpoint", 4, offsetof(TsRow, setpoint), 'f'},
+    {"temp_A", 4, offsetof(TsRow, temp_A), 'f'},
+    {"temp_B", 4, offsetof(TsRow, temp_B), 'f'},
+    {"internal", 4, offsetof(TsRow, internal), 'f'},
+    {"duty_A", 4, offsetof(TsRow, duty_A), 'f'},
+    {"duty_B", 4, offsetof(TsRow, duty_B), 'f'},
+    {"Kp", 4, offsetof(TsRow, Kp), 'f'},
+    {"Ki", 4, offsetof(TsRow, Ki), 'f'},
+    {"Kd", 4, offsetof(TsRow, Kd), 'f'},
+    {"adc_err", 1, offsetof(TsRow, adc_err), 'u'},
+    {"fuses", 1, offsetof(TsRow, fuses), 'u'},
+    {"gradient", 4, offsetof(TsRow, gradient), 'f'},
+};
+
+int tslog_column_by_name(const std::string &name)
+{
+    for (int c = 0; c < TSCOL_COUNT; c++)
+    {
+        if (name == COLUMNS[c].name)
+        {
+            return c;
+        }
+    }
+    return -1;
+}
+
+const char *tslog_column_name(int col)
+{
+    return COLUMNS[col].name;
+}
+
+std::string tslog_format(const TsRow &row, int col)
+{
+    const ColumnSpec &spec = COLUMNS[col];
+    const uint8_t *p = (const uint8_t *)&row + spec.row_offset;
+    char buf[32];
+    if (col == TSCOL_T)
+    {
+        snprintf(buf, sizeof(buf), "%.3f", row.t_us / 1e6);
+    }
+    else if (col == TSCOL_KIND)
+    {
+        return row.kind == TSLOG_KIND_ERR ? "ERR" : "DAT";
+    }
+    else if (col == TSCOL_ADC_ERR)
+    {
+        snprintf(buf, sizeof(buf), "%X", row.adc_err);
+    }
+    else if (spec.type == 'f')
+    {
+        float v;
+        memcpy(&v, p, sizeof(v));
+        if (isnan(v))
+        {
+            return std::string(); //empty CSV cell
+        }
+        snprintf(buf, sizeof(buf), "%g", v);
+    }
+    else if (spec.width == 4)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        snprintf(buf, sizeof(buf), "%u", v);
+    }
+    else
+    {
+        snprintf(buf, sizeof(buf), "%u", *p);
+    }
+    return buf;
+}
+
+static uint32_t page_round(uint32_t n)
+{
+    uint32_t page = sysconf(_SC_PAGESIZE);
+    return (n + page - 1) / page * page;
+}
+
+static void init_header(TsFileHeader &h)
+{
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TSLOG_MAGIC, 8);
+    h.version = TSLOG_VERSION;
+    h.header_bytes = TSLOG_HEADER_BYTES;
+    h.rows_per_block = TSLOG_ROWS_PER_BLOCK;
+    h.ncols = TSCOL_COUNT;
+    uint32_t offset = sizeof(TsBlockHeader);
+    for (int c = 0; c < TSCOL_COUNT; c++)
+    {
+        strncpy(h.cols[c].name, COLUMNS[c].name, sizeof(h.cols[c].name) - 1);
+        h.cols[c].width = COLUMNS[c].width;
+        offset = (offset + TSLOG_COLUMN_ALIGN - 1) / TSLOG_COLUMN_ALIGN * TSLOG_COLUMN_ALIGN;
+        h.cols[c].offset = offset;
+        offset += COLUMNS[c].width * TSLOG_ROWS_PER_BLOCK;
+    }
+    h.block_bytes = page_round(offset);
+}
+
+//columns a file of the given version has, 0 for versions we can't read. Each
+//version only adds columns at the end, so an older file's columns are a prefix
+//of ours and its rows read with the newer ones NaN/zero.
+static uint32_t columns_in_version(uint32_t version)
+{
+    switch (version)
+    {
+    case 1:
+        return TSCOL_GRADIENT;
+    case TSLOG_VERSION:
+        return TSCOL_COUNT;
+    default:
+        return 0;
+    }
+}
+
+static bool check_header(const TsFileHeader &h, size_t file_size, std::string &err)
+{
+    TsFileHeader expect;
+    init_header(expect);
+    if (memcmp(h.magic, TSLOG_MAGIC, 8) != 0)
+    {
+        err = "not a telemetry log";
+        return false;
+    }
+    uint32_t ncols = columns_in_version(h.version);
+    if (ncols == 0 || h.ncols != ncols || h.header_bytes != TSLOG_HEADER_BYTES ||
+        memcmp(h.cols, expect.cols, ncols * sizeof(h.cols[0])) != 0 || h.block_bytes % sysconf(_SC_PAGESIZE) != 0 ||
+        h.rows_per_block == 0)
+    {
+        err = "log written by an incompatible version";
+        return false;
+    }
+    if (h.header_bytes + h.nblocks * h.block_bytes > file_size)
+    {
+        err = "log is truncated";
+        return false;
+    }
+    return true;
+}
+
+//an older file being appended to keeps its layout: columns it has no room for are dropped
+static void put_row(uint8_t *block, const TsFileHeader &h, uint32_t i, const TsRow &row)
+{
+    for (uint32_t c = 0; c < h.ncols; c++)
+    {
+        memcpy(block + h.cols[c].offset + (size_t)i * h.cols[c].width,
+               (const uint8_t *)&row + COLUMNS[c].row_offset, h.cols[c].width);
+    }
+}
+
+static void get_row(const uint8_t *block, const TsFileHeader &h, uint32_t i, TsRow &row)
+{
+    for (uint32_t c = 0; c < TSCOL_COUNT; c++)
+    {
+        uint8_t *field = (uint8_t *)&row + COLUMNS[c].row_offset;
+        if (c >= h.ncols)
+        {
+            //not in an older file
+            if (COLUMNS[c].type == 'f')
+            {
+                float v = NAN;
+                memcpy(field, &v, sizeof(v));
+            }
+            else
+            {
+                memset(field, 0, COLUMNS[c].width);
+            }
+            continue;
+        }
+        memcpy(field, block + h.cols[c].offset + (size_t)i * h.cols[c].width, h.cols[c].width);
+    }
+}
+
+static int64_t get_time(const uint8_t *block, const TsFileHeader &h, uint32_t i)
+{
+    int64_t t;
+    memcpy(&t, block + h.cols[TSCOL_T].offset + (size_t)i * sizeof(t), sizeof(t));
+    return t;
+}
+
+static uint32_t get_run(const uint8_t *block, const TsFileHeader &h, uint32_t i)
+{
+    uint32_t r;
+    memcpy(&r, block + h.cols[TSCOL_RUN].offset + (size_t)i * sizeof(r), sizeof(r));
+    return r;
+}
+
+static uint32_t committed_rows(const TsBlockHeader *b)
+{
+    return __atomic_load_n(&b->nrows, __ATOMIC_ACQUIRE);
+}
+
+//------------------------------------------------------------------ writer
+TsLogWriter::~TsLogWriter()
+{
+    unmap_block();
+    if (hdr)
+    {
+        msync(hdr, TSLOG_HEADER_BYTES, MS_SYNC);
+        munmap(hdr, TSLOG_HEADER_BYTES);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+bool TsLogWriter::open(const std::string &path, std::string &err)
+{
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        err = path + ": " + strerror(errno);
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    bool fresh = st.st_size == 0;
+    if (fresh && ftruncate(fd, TSLOG_HEADER_BYTES))
+    {
+        err = path + ": " + strerror(errno);
+        return false;
+    }
+    void *p = mmap(nullptr, TSLOG_HEADER_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        err = path + ": " + strerror(errno);
+        return false;
+    }
+    hdr = (TsFileHeader *)p;
+    if (fresh)
+    {
+        init_header(*hdr);
+        return true;
+    }
+    if (!check_header(*hdr, st.st_size, err))
+    {
+        err = path + ": " + err;
+        return false;
+    }
+    if (hdr->nblocks == 0)
+    {
+        return true;
+    }
+    //resume in the last block, after its last committed row
+    if (!map_block(hdr->nblocks - 1, false, err))
+    {
+        return false;
+    }
+    const TsBlockHeader *b = (const TsBlockHeader *)block;
+    uint32_t n = committed_rows(b);
+    if (n)
+    {
+        TsRow last;
+        get_row(block, *hdr, n - 1, last);
+        last_t = last.t_us;
+        run = last.run;
+        uptime = last.uptime;
+    }
+    return true;
+}
+
+bool TsLogWriter::map_block(uint64_t index, bool fresh, std::string &err)
+{
+    unmap_block();
+    off_t offset = TSLOG_HEADER_BYTES + (off_t)index * hdr->block_bytes;
+    if (fresh)
+    {
+        //grow the file by one block; the new pages read back as zero
+        if (ftruncate(fd, offset + hdr->block_bytes))
+        {
+            err = strerror(errno);
+            return false;
+        }
+    }
+    void *p = mmap(nullptr, hdr->block_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+    if (p == MAP_FAILED)
+    {
+        err = strerror(errno);
+        return false;
+    }
+    block = (uint8_t *)p;
+    block_index = index;
+    if (fresh)
+    {
+        hdr->nblocks = index + 1;
+    }
+    return true;
+}
+
+void TsLogWriter::unmap_block()
+{
+    if (block)
+    {
+        msync(block, hdr->block_bytes, MS_ASYNC);
+        munmap(block, hdr->block_bytes);
+        block = nullptr;
+    }
+}
+
+bool TsLogWriter::append(const TsRow &in, std::string &err)
+{
+    if (!block || committed_rows((TsBlockHeader *)block) == hdr->rows_per_block)
+    {
+        if (!map_block(block ? block_index + 1 : 0, true, err))
+        {
+            return false;
+        }
+    }
+    TsRow row = in;
+    //the time index relies on rows never going back in time (clock steps, NTP)
+    if (row.t_us < last_t)
+    {
+        row.t_us = last_t;
+    }
+    TsBlockHeader *b = (TsBlockHeader *)block;
+    uint32_t i = b->nrows;
+    put_row(block, *hdr, i, row);
+    if (i == 0)
+    {
+        b->t_first = row.t_us;
+        b->run_first = row.run;
+    }
+    b->t_last = row.t_us;
+    b->run_last = row.run;
+    if (row.kind == TSLOG_KIND_ERR)
+    {
+        b->nerr++;
+    }
+    //publish the row only once all of its columns are in place
+    __atomic_store_n(&b->nrows, i + 1, __ATOMIC_RELEASE);
+
+    last_t = row.t_us;
+    run = row.run;
+    if (row.kind == TSLOG_KIND_DAT)
+    {
+        uptime = row.uptime;
+    }
+    return true;
+}
+
+void TsLogWriter::flush()
+{
+    if (block)
+    {
+        msync(block, hdr->block_bytes, MS_ASYNC);
+    }
+    msync(hdr, TSLOG_HEADER_BYTES, MS_ASYNC);
+}
+
+uint64_t TsLogWriter::rows() const
+{
+    if (!block)
+    {
+        return 0;
+    }
+    return block_index * hdr->rows_per_block + committed_rows((const TsBlockHeader *)block);
+}
+
+//------------------------------------------------------------------ reader
+TsLogReader::~TsLogReader()
+{
+    if (base)
+    {
+        munmap((void *)base, size);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+bool TsLogReader::open(const std::string &path, std::string &err)
+{
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        err = path + ": " + strerror(errno);
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    if (st.st_size < TSLOG_HEADER_BYTES)
+    {
+        err = path + ": not a telemetry log";
+        return false;
+    }
+    //map it all: address space is cheap, and only the pages a query touches get read
+    size = st.st_size;
+    void *p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        err = path + ": " + strerror(errno);
+        return false;
+    }
+    base = (const uint8_t *)p;
+    hdr = (const TsFileHeader *)base;
+    if (!check_header(*hdr, size, err))
+    {
+        err = path + ": " + err;
+        return false;
+    }
+    return true;
+}
+
+uint64_t TsLogReader::blocks() const
+{
+    //a writer may have grown the file since it was mapped; stay inside the mapping
+    uint64_t mapped = (size - hdr->header_bytes) / hdr->block_bytes;
+    return hdr->nblocks < mapped ? hdr->nblocks : mapped;
+}
+
+const TsBlockHeader *TsLogReader::block_header(uint64_t index) const
+{
+    return (const TsBlockHeader *)block_data(index);
+}
+
+const uint8_t *TsLogReader::block_data(uint64_t index) const
+{
+    return base + hdr->header_bytes + index * hdr->block_bytes;
+}
+
+uint64_t TsLogReader::rows() const
+{
+    uint64_t n = blocks();
+    return n ? (n - 1) * hdr->rows_per_block + committed_rows(block_header(n - 1)) : 0;
+}
+
+int64_t TsLogReader::first_time() const
+{
+    return empty() ? 0 : block_header(0)->t_first;
+}
+
+int64_t TsLogReader::last_time() const
+{
+    return empty() ? 0 : block_header(blocks() - 1)->t_last;
+}
+
+uint32_t TsLogReader::last_run() const
+{
+    return empty() ? 0 : block_header(blocks() - 1)->run_last;
+}
+
+void TsLogReader::read_row(uint64_t block, uint32_t i, TsRow &row) const
+{
+    get_row(block_data(block), *hdr, i, row);
+}
+
+uint64_t TsLogReader::first_block_ending_after(int64_t t) const
+{
+    //block t_last values never decrease, so binary search the block headers
+    uint64_t lo = 0, hi = blocks();
+    while (lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (committed_rows(block_header(mid)) && block_header(mid)->t_last < t)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void TsLogReader::scan_time(int64_t t0, int64_t t1, uint32_t run, const std::function<bool(const TsRow &)> &fn) const
+{
+    uint64_t nblocks = blocks();
+    for (uint64_t b = first_block_ending_after(t0); b < nblocks; b++)
+    {
+        const uint8_t *data = block_data(b);
+        uint32_t n = committed_rows(block_header(b));
+        if (n == 0 || block_header(b)->t_first >= t1)
+        {
+            return;
+        }
+        if (run != UINT32_MAX && (block_header(b)->run_last < run || block_header(b)->run_first > run))
+        {
+            if (block_header(b)->run_first > run)
+            {
+                return;
+            }
+            continue;
+        }
+        //first row at or after t0 within the block
+        uint32_t lo = 0, hi = n;
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (get_time(data, *hdr, mid) < t0)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        for (uint32_t i = lo; i < n; i++)
+        {
+            if (get_time(data, *hdr, i) >= t1)
+            {
+                return;
+            }
+            if (run != UINT32_MAX && get_run(data, *hdr, i) != run)
+            {
+                continue;
+            }
+            TsRow row;
+            read_row(b, i, row);
+            if (!fn(row))
+            {
+                return;
+            }
+        }
+    }
+}
+
+void TsLogReader::scan_errors(uint32_t run, const std::function<bool(const TsRow &)> &fn) const
+{
+    uint64_t nblocks = blocks();
+    uint64_t b = 0;
+    if (run != UINT32_MAX)
+    {
+        //run numbers never decrease either
+        uint64_t hi = nblocks;
+        while (b < hi)
+        {
+            uint64_t mid = b + (hi - b) / 2;
+            if (committed_rows(block_header(mid)) && block_header(mid)->run_last < run)
+            {
+                b = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+    }
+    for (; b < nblocks; b++)
+    {
+        const TsBlockHeader *bh = block_header(b);
+        if (run != UINT32_MAX && bh->run_first > run)
+        {
+            return;
+        }
+        if (bh->nerr == 0)
+        {
+            continue; //nothing to see here, don't touch the column pages
+        }
+        const uint8_t *data = block_data(b);
+        const uint8_t *kinds = data + hdr->cols[TSCOL_KIND].offset;
+        uint32_t n = committed_rows(bh);
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (kinds[i] != TSLOG_KIND_ERR || (run != UINT32_MAX && get_run(data, *hdr, i) != run))
+            {
+                continue;
+            }
+            TsRow row;
+            read_row(b, i, row);
+            if (!fn(row))
+            {
+                return;
+            }
+        }
+    }
+}
+
+bool TsLogReader::run_span(uint32_t run, int64_t &t0, int64_t &t1) const
+{
+    bool found = false;
+    uint64_t nblocks = blocks();
+    //first block that reaches the run, then walk until the run is over
+    uint64_t lo = 0, hi = nblocks;
+    while (lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (committed_rows(block_header(mid)) && block_header(mid)->run_last < run)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    for (uint64_t b = lo; b < nblocks; b++)
+    {
+        const TsBlockHeader *bh = block_header(b);
+        uint32_t n = committed_rows(bh);
+        if (n == 0 || bh->run_first > run)
+        {
+            break;
+        }
+        const uint8_t *data = block_data(b);
+        if (bh->run_first == run && bh->run_last == run)
+        {
+            //whole block belongs to the run
+            if (!found)
+            {
+                t0 = bh->t_first;
+            }
+            t1 = bh->t_last;
+            found = true;
+            continue;
+        }
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (get_run(data, *hdr, i) == run)
+            {
+                if (!found)
+                {
+                    t0 = get_time(data, *hdr, i);
+                }
+                t1 = get_time(data, *hdr, i);
+                found = true;
+            }
+        }
+    }
+    return found;
+}
@@ -0,0 +1,120 @@
+#pragma once
+//Append-only telemetry log: one memory-mapped file of fixed-size blocks.
+//
+//  [file header, 4kB][block 0][block 1]...
+//
+//Each block holds up to rows_per_block rows stored column by column, after a
+//small header with the block's time span, run span and ERR count. Rows are
+//appended in time order, so the block headers double as a time index: a
+//query binary-searches the blocks, then the time column inside a block, and
+//only ever touches the pages it returns. The writer keeps just the file
+//header and the block being filled mapped, so its memory use stays flat no
+//matter how long the file grows.
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <functional>
+
+#define TSLOG_KIND_DAT 0
+#define TSLOG_KIND_ERR 1
+
+struct TsRow
+{
+    int64_t t_us;  //host wall clock when the frame arrived, us since the epoch
+    uint32_t run;  //increments each time the controller reboots
+    uint8_t kind;  //TSLOG_KIND_*
+    //<DAT> fields, NaN in ERR rows
+    float uptime, setpoint, temp_A, temp_B, internal, duty_A, duty_B, Kp, Ki, Kd;
+    float gradient; //also NaN from firmware without <GRD> and in files from before it
+    //<ERR> fields, zero in DAT rows
+    uint8_t adc_err, fuses;
+};
+
+enum TsColumn
+{
+    TSCOL_T,
+    TSCOL_RUN,
+    TSCOL_KIND,
+    TSCOL_UPTIME,
+    TSCOL_SETPOINT,
+    TSCOL_TEMP_A,
+    TSCOL_TEMP_B,
+    TSCOL_INTERNAL,
+    TSCOL_DUTY_A,
+    TSCOL_DUTY_B,
+    TSCOL_KP,
+    TSCOL_KI,
+    TSCOL_KD,
+    TSCOL_ADC_ERR,
+    TSCOL_FUSES,
+    TSCOL_GRADIENT, //last, so the older layout is a prefix of this one
+    TSCOL_COUNT
+};
+
+//column name as used on the command line ("temp_A"), or -1
+int tslog_column_by_name(const std::string &name);
+const char *tslog_column_name(int col);
+//formats one column of a row for CSV output
+std::string tslog_format(const TsRow &row, int col);
+
+struct TsFileHeader;
+struct TsBlockHeader;
+
+class TsLogWriter
+{
+public:
+    ~TsLogWriter();
+    //creates path, or reopens it to append after the last committed row
+    bool open(const std::string &path, std::string &err);
+    bool append(const TsRow &row, std::string &err);
+    //asks the kernel to start writing dirty pages back
+    void flush();
+    //run number and uptime of the last row, to continue numbering runs
+    uint32_t last_run() const { return run; }
+    float last_uptime() const { return uptime; }
+    uint64_t rows() const;
+
+private:
+    int fd = -1;
+    TsFileHeader *hdr = nullptr;
+    uint8_t *block = nullptr; //block currently being filled
+    uint64_t block_index = 0;
+    int64_t last_t = INT64_MIN;
+    uint32_t run = 0;
+    float uptime = 0;
+
+    bool map_block(uint64_t index, bool fresh, std::string &err);
+    void unmap_block();
+};
+
+class TsLogReader
+{
+public:
+    ~TsLogReader();
+    bool open(const std::string &path, std::string &err);
+    uint64_t rows() const;
+    uint64_t blocks() const;
+    bool empty() const { return rows() == 0; }
+    int64_t first_time() const;
+    int64_t last_time() const;
+    uint32_t last_run() const;
+
+    //rows with t0 <= t < t1 (and run == run unless run is UINT32_MAX), in order;
+    //return false from fn to stop early
+    void scan_time(int64_t t0, int64_t t1, uint32_t run, const std::function<bool(const TsRow &)> &fn) const;
+    //ERR rows of one run (every run if run is UINT32_MAX), skipping blocks without any
+    void scan_errors(uint32_t run, const std::function<bool(const TsRow &)> &fn) const;
+    //time span of a run, false if the file has no such run
+    bool run_span(uint32_t run, int64_t &t0, int64_t &t1) const;
+
+private:
+    int fd = -1;
+    const uint8_t *base = nullptr;
+    size_t size = 0;
+    const TsFileHeader *hdr = nullptr;
+
+    const TsBlockHeader *block_header(uint64_t index) const;
+    const uint8_t *block_data(uint64_t index) const;
+    void read_row(uint64_t block, uint32_t i, TsRow &row) const;
+    uint64_t first_block_ending_after(int64_t t) const;
+};
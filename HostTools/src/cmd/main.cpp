@@ -0,0 +1,191 @@
+//anneal-cmd: sends commands through the gateway and reports how each was answered
+#include "pipeline.h"
+#include "frame.h"
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <iostream>
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-s SOCKET] [-t MS] [COMMAND...]\n"
+            "  COMMAND  a frame such as \"<SET,-200>\"; without any, frames are read from stdin\n"
+            "  -s       gateway socket (default /tmp/anneal-gateway.sock)\n"
+            "  -t       give up on a command not answered after this long (default 1000)\n"
+            "commands are numbered and sent without waiting for each other's answers;\n"
+            "the exit status is 1 unless every one of them was acknowledged\n",
+            prog);
+}
+
+static uint64_t monotonic_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int connect_gateway(const char *path)
+{
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)))
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool write_all(int fd, const std::string &s)
+{
+    size_t done = 0;
+    while (done < s.size())
+    {
+        ssize_t n = write(fd, s.data() + done, s.size() - done);
+        if (n < 0 && errno != EINTR)
+        {
+            return false;
+        }
+        done += n > 0 ? n : 0;
+    }
+    return true;
+}
+
+//"<SET,-200>: ACK -200.00", "<FOO>: NAK invalid", "<SAV>: no reply"
+static bool report(const PipelineResult &r)
+{
+    printf("%s: ", r.command.c_str());
+    if (!r.answered)
+    {
+        printf("no reply\n");
+        return false;
+    }
+    if (!r.reply.ack)
+    {
+        const char *why = r.reply.code == PROTO_NAK_INVALID ? "invalid" : r.reply.code == PROTO_NAK_REFUSED ? "refused" : "?";
+        printf("NAK %s\n", why);
+        return false;
+    }
+    printf("ACK");
+    for (float v : r.reply.values)
+    {
+        printf(" %g", v);
+    }
+    printf("\n");
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *sock = "/tmp/anneal-gateway.sock";
+    uint32_t timeout_ms = 1000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:t:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            sock = optarg;
+            break;
+        case 't':
+            timeout_ms = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    CommandPipeline pipe(timeout_ms);
+    std::vector<std::string> frames;
+    if (optind < argc)
+    {
+        for (int i = optind; i < argc; i++)
+        {
+            frames.push_back(argv[i]);
+        }
+    }
+    else
+    {
+        std::string line;
+        while (std::getline(std::cin, line))
+        {
+            for (const std::string &frame : frames_in(line))
+            {
+                frames.push_back(frame);
+            }
+        }
+    }
+    for (const std::string &frame : frames)
+    {
+        if (!pipe.push(frame))
+        {
+            fprintf(stderr, "%s: not a command the controller takes: %s\n", argv[0], frame.c_str());
+            return 1;
+        }
+    }
+
+    int fd = connect_gateway(sock);
+    if (fd < 0)
+    {
+        fprintf(stderr, "%s: cannot reach gateway at %s: %s\n", argv[0], sock, strerror(errno));
+        return 1;
+    }
+
+    bool all_ok = true;
+    LineSplitter lines;
+    while (!pipe.idle())
+    {
+        uint64_t now = monotonic_ms();
+        std::string out;
+        for (std::string frame; !(frame = pipe.next_to_send(now)).empty();)
+        {
+            out += frame + "\n";
+        }
+        if (!write_all(fd, out))
+        {
+            fprintf(stderr, "%s: gateway went away\n", argv[0]);
+            return 1;
+        }
+
+        PipelineResult r;
+        while (pipe.expired(now, r))
+        {
+            all_ok &= report(r);
+        }
+
+        pollfd p = {fd, POLLIN, 0};
+        if (poll(&p, 1, 50) > 0)
+        {
+            char buf[4096];
+            ssize_t len = read(fd, buf, sizeof(buf));
+            if (len <= 0)
+            {
+                fprintf(stderr, "%s: gateway went away\n", argv[0]);
+                return 1;
+            }
+            lines.feed(buf, len);
+            std::string line;
+            while (lines.next(line))
+            {
+                if (pipe.on_line(line, r))
+                {
+                    all_ok &= report(r);
+                }
+            }
+        }
+    }
+    close(fd);
+    return all_ok ? 0 : 1;
+}
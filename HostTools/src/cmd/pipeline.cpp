@@ -0,0 +1,82 @@
+#include "pipeline.h"
+
+//",#65535": the gateway may hand the firmware a longer number than ours
+#define SEQ_BYTES 7
+
+bool CommandPipeline::push(const std::string &frame)
+{
+    Command c;
+    uint16_t seq;
+    if (frame_seq(frame, seq) || frame.size() + SEQ_BYTES >= ANNEAL_RXBUF_LEN || !decode_command(frame, c))
+    {
+        return false;
+    }
+    queued.push_back(frame);
+    return true;
+}
+
+std::string CommandPipeline::next_to_send(uint64_t now_ms)
+{
+    if (queued.empty())
+    {
+        return std::string();
+    }
+    const std::string &command = queued.front();
+    size_t bytes = command.size() + SEQ_BYTES;
+    //one command always goes, however long, or a long one could never be sent
+    if (!in_flight.empty() && window_used + bytes > ANNEAL_RX_WINDOW)
+    {
+        return std::string();
+    }
+    //wraps from 65535 to 0, which is a number like any other: the ones in
+    //flight are never more than the window's worth apart
+    Sent s = {command, next_seq++, bytes, now_ms};
+    std::string numbered = command.substr(0, command.size() - 1) + ",#" + std::to_string(s.seq) + '>';
+    in_flight.push_back(s);
+    window_used += bytes;
+    queued.pop_front(); //command refers to it
+    return numbered;
+}
+
+void CommandPipeline::retire(std::deque<Sent>::iterator it, PipelineResult &result)
+{
+    result.command = it->command;
+    window_used -= it->bytes;
+    in_flight.erase(it);
+}
+
+bool CommandPipeline::on_line(const std::string &line, PipelineResult &result)
+{
+    for (const std::string &frame : frames_in(line))
+    {
+        Reply reply;
+        if (!parse_reply(frame, reply))
+        {
+            continue;
+        }
+        for (auto it = in_flight.begin(); it != in_flight.end(); ++it)
+        {
+            if (it->seq == reply.seq)
+            {
+                result.answered = true;
+                result.reply = reply;
+                retire(it, result);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool CommandPipeline::expired(uint64_t now_ms, PipelineResult &result)
+{
+    //sent in order, so the oldest is first
+    if (in_flight.empty() || now_ms - in_flight.front().sent_ms < timeout_ms)
+    {
+        return false;
+    }
+    result.answered = false;
+    result.reply = Reply();
+    retire(in_flight.begin(), result);
+    return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+//Keeps several numbered commands on the way to the controller at once,
+//instead of sending one and waiting a round trip for its <ACK>. What may be
+//outstanding is bounded in bytes, not commands (ANNEAL_RX_WINDOW): everything
+//not yet answered could still be sitting in the firmware's 64 byte receive
+//ring, and a byte past that is lost without a word. The gateway holds the
+//same limit over all its clients together.
+#include "command.h"
+#include "frame.h"
+#include <stdint.h>
+#include <deque>
+#include <string>
+
+struct PipelineResult
+{
+    std::string command; //as given, without the sequence number
+    bool answered;       //false: no reply before the timeout
+    Reply reply;
+};
+
+class CommandPipeline
+{
+public:
+    explicit CommandPipeline(uint32_t timeout_ms) : timeout_ms(timeout_ms) {}
+
+    //false if frame isn't a command the firmware would take, numbered
+    bool push(const std::string &frame);
+    //the next command to write if the window has room for it, numbered; empty otherwise
+    std::string next_to_send(uint64_t now_ms);
+    //a line from the controller: true, with the command it answers, for an <ACK>/<NAK> of ours
+    bool on_line(const std::string &line, PipelineResult &result);
+    //the oldest command sent before now_ms - timeout that was never answered
+    bool expired(uint64_t now_ms, PipelineResult &result);
+    //nothing queued, nothing outstanding
+    bool idle() const { return queued.empty() && in_flight.empty(); }
+
+private:
+    struct Sent
+    {
+        std::string command;
+        uint16_t seq;
+        size_t bytes; //as the firmware may see it: the gateway renumbers
+        uint64_t sent_ms;
+    };
+
+    uint32_t timeout_ms;
+    uint16_t next_seq = 1;
+    size_t window_used = 0;
+    std::deque<std::string> queued;
+    std::deque<Sent> in_flight;
+
+    void retire(std::deque<Sent>::iterator it, PipelineResult &result);
+};
@@ -0,0 +1,714 @@
+#include "gateway.h"
+#include "serial_port.h"
+#include "command.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RECONNECT_MS 1000
+#define SERIAL_OUT_MAX 64 //frames; the firmware only takes one per loop() anyway
+#define ANSWER_TIMEOUT_MS 2000 //a numbered command not answered by then never will be
+#define EXPIRE_CHECK_MS 250
+
+static uint64_t monotonic_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+Gateway::Gateway(const Options &opts) : opts(opts) {}
+
+Gateway::~Gateway()
+{
+    for (auto &kv : clients)
+    {
+        close(kv.first);
+    }
+    close_serial();
+    for (int fd : {listen_fd, signal_fd, keepalive_fd, reconnect_fd, expire_fd, epfd})
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+    if (listen_fd >= 0)
+    {
+        unlink(opts.socket_path.c_str());
+    }
+    if (record)
+    {
+        fclose(record);
+    }
+}
+
+void Gateway::watch(int fd, uint32_t events)
+{
+    epoll_event ev = {};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) && errno == ENOENT)
+    {
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+void Gateway::arm_timer(int fd, uint32_t first_ms, uint32_t interval_ms)
+{
+    itimerspec its = {};
+    its.it_value.tv_sec = first_ms / 1000;
+    its.it_value.tv_nsec = (first_ms % 1000) * 1000000L;
+    its.it_interval.tv_sec = interval_ms / 1000;
+    its.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+    timerfd_settime(fd, 0, &its, nullptr);
+}
+
+bool Gateway::setup()
+{
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+
+    //SIGINT/SIGTERM arrive as readable events on the loop, not as interruptions
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    watch(signal_fd, EPOLLIN);
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (opts.socket_path.size() >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "gateway: socket path too long: %s\n", opts.socket_path.c_str());
+        return false;
+    }
+    strcpy(addr.sun_path, opts.socket_path.c_str());
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(addr.sun_path); //stale socket from an earlier run
+    if (bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) || listen(listen_fd, 8))
+    {
+        fprintf(stderr, "gateway: %s: %s\n", addr.sun_path, strerror(errno));
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    chmod(addr.sun_path, 0660);
+    watch(listen_fd, EPOLLIN);
+
+    if (!opts.record_path.empty())
+    {
+        record = fopen(opts.record_path.c_str(), "a");
+        if (!record)
+        {
+            fprintf(stderr, "gateway: %s: %s\n", opts.record_path.c_str(), strerror(errno));
+            return false;
+        }
+        setvbuf(record, nullptr, _IOLBF, 0); //a crash loses at most the line being written
+    }
+
+    keepalive_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    watch(keepalive_fd, EPOLLIN);
+    if (opts.keepalive_ms)
+    {
+        //check a few times per interval so a keepalive is never much late
+        uint32_t tick = opts.keepalive_ms / 4 ? opts.keepalive_ms / 4 : 1;
+        arm_timer(keepalive_fd, tick, tick);
+    }
+
+    expire_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    watch(expire_fd, EPOLLIN);
+    arm_timer(expire_fd, EXPIRE_CHECK_MS, EXPIRE_CHECK_MS);
+
+    reconnect_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    watch(reconnect_fd, EPOLLIN);
+    if (!open_serial())
+    {
+        arm_timer(reconnect_fd, RECONNECT_MS, 0);
+    }
+    return true;
+}
+
+bool Gateway::open_serial()
+{
+    std::string err;
+    serial_fd = serial_open(opts.device.c_str(), ANNEAL_BAUD, err);
+    if (serial_fd < 0)
+    {
+        if (!serial_missing)
+        {
+            fprintf(stderr, "gateway: %s, retrying\n", err.c_str());
+        }
+        serial_missing = true;
+        return false;
+    }
+    serial_missing = false;
+    fprintf(stderr, "gateway: connected to %s\n", opts.device.c_str());
+    serial_in.clear();
+    serial_out_sent = 0;
+    watch(serial_fd, EPOLLIN | (serial_out.empty() ? 0u : (uint32_t)EPOLLOUT));
+    return true;
+}
+
+void Gateway::close_serial()
+{
+    if (serial_fd >= 0)
+    {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, serial_fd, nullptr);
+        close(serial_fd);
+        serial_fd = -1;
+    }
+}
+
+int Gateway::run()
+{
+    if (!start())
+    {
+        return 1;
+    }
+    int status;
+    while ((status = poll(-1)) < 0)
+    {
+    }
+    return status;
+}
+
+bool Gateway::start()
+{
+    if (!setup())
+    {
+        return false;
+    }
+    fprintf(stderr, "gateway: listening on %s\n", opts.socket_path.c_str());
+    return true;
+}
+
+int Gateway::poll(int timeout_ms)
+{
+    epoll_event events[32];
+    int n = epoll_wait(epfd, events, 32, timeout_ms);
+    if (n < 0)
+    {
+        if (errno == EINTR)
+        {
+            return -1;
+        }
+        perror("gateway: epoll_wait");
+        return 1;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        int fd = events[i].data.fd;
+        uint32_t ev = events[i].events;
+        if (fd == signal_fd)
+        {
+            fprintf(stderr, "gateway: shutting down\n");
+            return 0;
+        }
+        else if (fd == serial_fd)
+        {
+            on_serial(ev);
+        }
+        else if (fd == listen_fd)
+        {
+            on_accept();
+        }
+        else if (fd == keepalive_fd)
+        {
+            on_keepalive();
+        }
+        else if (fd == expire_fd)
+        {
+            on_expire();
+        }
+        else if (fd == reconnect_fd)
+        {
+            uint64_t expirations;
+            if (read(reconnect_fd, &expirations, sizeof(expirations)) > 0 && serial_fd < 0 && !open_serial())
+            {
+                arm_timer(reconnect_fd, RECONNECT_MS, 0);
+            }
+        }
+        else if (clients.count(fd))
+        {
+            on_client(fd, ev);
+        }
+    }
+    return -1;
+}
+
+void Gateway::on_serial(uint32_t events)
+{
+    if (events & EPOLLIN)
+    {
+        char buf[4096];
+        ssize_t len;
+        while ((len = read(serial_fd, buf, sizeof(buf))) > 0)
+        {
+            serial_in.feed(buf, len);
+        }
+        std::string line;
+        while (serial_in.next(line))
+        {
+            if (!line.empty())
+            {
+                record_line('<', line);
+                if (line == "boot")
+                {
+                    forget_pending(); //whatever it hadn't answered went with the reset
+                }
+                if (!route_reply(line))
+                {
+                    broadcast(line);
+                }
+            }
+        }
+        if (len == 0 || (len < 0 && errno != EAGAIN))
+        {
+            events |= EPOLLHUP;
+        }
+    }
+    if (events & (EPOLLHUP | EPOLLERR))
+    {
+        //adaptor unplugged or simulator gone: keep clients, retry the port
+        fprintf(stderr, "gateway: lost %s\n", opts.device.c_str());
+        close_serial();
+        drop_unsent();
+        forget_pending();
+        arm_timer(reconnect_fd, RECONNECT_MS, 0);
+        return;
+    }
+    if (events & EPOLLOUT)
+    {
+        flush_serial();
+    }
+}
+
+void Gateway::on_accept()
+{
+    int fd;
+    while ((fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+        clients[fd];
+        watch(fd, EPOLLIN);
+    }
+}
+
+void Gateway::on_client(int fd, uint32_t events)
+{
+    Client &c = clients[fd];
+    if (events & EPOLLIN)
+    {
+        char buf[1024];
+        ssize_t len;
+        while ((len = read(fd, buf, sizeof(buf))) > 0)
+        {
+            c.in.feed(buf, len);
+        }
+        bool closed = len == 0 || (len < 0 && errno != EAGAIN);
+        std::string line;
+        while (c.in.next(line))
+        {
+            for (const std::string &frame : frames_in(line))
+            {
+                if (frame_is_command(frame))
+                {
+                    c.last_command_ms = monotonic_ms();
+                    forward_command(fd, frame);
+                }
+                else
+                {
+                    fprintf(stderr, "gateway: ignoring malformed command %s\n", frame.c_str());
+                }
+            }
+        }
+        if (closed)
+        {
+            drop_client(fd, nullptr); //after forwarding what it sent before hanging up
+            return;
+        }
+        if (c.in.pending() > 4 * ANNEAL_RXBUF_LEN)
+        {
+            drop_client(fd, "sent an overlong line");
+            return;
+        }
+    }
+    if (events & (EPOLLHUP | EPOLLERR))
+    {
+        drop_client(fd, nullptr);
+        return;
+    }
+    if (events & EPOLLOUT)
+    {
+        flush_client(fd, c);
+    }
+}
+
+void Gateway::on_keepalive()
+{
+    uint64_t expirations;
+    if (read(keepalive_fd, &expirations, sizeof(expirations)) <= 0)
+    {
+        return;
+    }
+    if (serial_fd >= 0 && in_charge() && monotonic_ms() - last_command_ms >= opts.keepalive_ms)
+    {
+        send_command("<NOP>");
+    }
+}
+
+//true while a client that commands the controller is still there. Only then
+//is it kept alive: once the GUI has gone, the firmware's comms timeout has to
+//be able to stop the heaters (a client that only listens, like a logger, doesn't count)
+bool Gateway::in_charge()
+{
+    uint64_t now = monotonic_ms();
+    for (const auto &kv : clients)
+    {
+        uint64_t last = kv.second.last_command_ms;
+        if (last && (!opts.client_idle_ms || now - last < opts.client_idle_ms))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//"MS DIR text", the format anneal-sim --replay reads. MS is the monotonic
+//clock, so sessions appended by later gateway runs stay in order
+void Gateway::record_line(char dir, const std::string &line)
+{
+    if (record)
+    {
+        fprintf(record, "%llu %c %s\n", (unsigned long long)monotonic_ms(), dir, line.c_str());
+    }
+}
+
+//commands that take the controller out of estop
+static bool clears_estop(const std::string &frame)
+{
+    std::string tag = frame_tag(frame);
+    return tag == "SET" || tag == "GRD" || tag == "ATN";
+}
+
+void Gateway::send_command(const std::string &frame)
+{
+    if (serial_fd < 0)
+    {
+        //queued up, it would all arrive stale and at once while the board is
+        //still coming out of the reset opening the port gives it
+        fprintf(stderr, "gateway: no controller, dropping %s\n", frame.c_str());
+        return;
+    }
+    last_command_ms = monotonic_ms();
+    record_line('>', frame);
+    if (frame_tag(frame) == "OFF")
+    {
+        //the safety command overtakes everything not already on the wire,
+        //and what would undo it doesn't go at all
+        size_t first = serial_out_sent ? 1 : 0;
+        for (auto it = serial_out.begin() + first; it != serial_out.end();)
+        {
+            if (clears_estop(*it))
+            {
+                fprintf(stderr, "gateway: dropping %s, overtaken by <OFF>\n", it->c_str());
+                uint16_t seq;
+                auto p = frame_seq(*it, seq) ? pending.find(seq) : pending.end();
+                if (p != pending.end())
+                {
+                    refuse(p->second.fd, p->second.seq);
+                    answered(p);
+                }
+                it = serial_out.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        serial_out.insert(serial_out.begin() + first, frame);
+    }
+    else if (serial_out.size() < SERIAL_OUT_MAX)
+    {
+        serial_out.push_back(frame);
+    }
+    else
+    {
+        fprintf(stderr, "gateway: serial queue full, dropping %s\n", frame.c_str());
+        return;
+    }
+    flush_serial();
+}
+
+void Gateway::forward_command(int fd, const std::string &frame)
+{
+    uint16_t seq;
+    if (serial_fd < 0)
+    {
+        fprintf(stderr, "gateway: no controller, dropping %s\n", frame.c_str());
+        if (frame_seq(frame, seq))
+        {
+            refuse(fd, seq);
+        }
+        return;
+    }
+    if (frame_tag(frame) == "OFF")
+    {
+        //never waits for the window, so it overtakes the held commands. any
+        //of them that would undo it must not follow it in
+        for (auto it = held.begin(); it != held.end();)
+        {
+            if (clears_estop(it->frame))
+            {
+                fprintf(stderr, "gateway: dropping %s, overtaken by <OFF>\n", it->frame.c_str());
+                if (frame_seq(it->frame, seq))
+                {
+                    refuse(it->fd, seq);
+                }
+                it = held.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        send_command(frame_seq(frame, seq) ? number(fd, seq, frame) : frame);
+        return;
+    }
+    if (held.size() >= SERIAL_OUT_MAX)
+    {
+        fprintf(stderr, "gateway: too many commands waiting, dropping %s\n", frame.c_str());
+        return;
+    }
+    held.push_back({fd, frame});
+    release_held();
+}
+
+//sends held commands in order while the window has room for them
+void Gateway::release_held()
+{
+    while (!held.empty())
+    {
+        const Held &h = held.front();
+        uint16_t seq;
+        if (!frame_seq(h.frame, seq))
+        {
+            //no answer will come to free the window: these go as they are,
+            //into the part of the ring the window leaves
+            send_command(h.frame);
+            held.pop_front();
+            continue;
+        }
+        //one command always goes, however long, or a long one could never be sent
+        if (!pending.empty() && window_used + frame_with_seq(h.frame, free_seq()).size() > ANNEAL_RX_WINDOW)
+        {
+            return;
+        }
+        std::string wire = number(h.fd, seq, h.frame);
+        held.pop_front();
+        send_command(wire);
+    }
+}
+
+//the next of our sequence numbers not still waiting for an answer
+uint16_t Gateway::free_seq()
+{
+    while (pending.count(next_seq))
+    {
+        next_seq++;
+    }
+    return next_seq;
+}
+
+//the frame under the next free one of our sequence numbers, counted as
+//pending for the client's seq
+std::string Gateway::number(int fd, uint16_t seq, const std::string &frame)
+{
+    std::string wire = frame_with_seq(frame, free_seq());
+    pending[next_seq++] = {fd, seq, wire.size(), monotonic_ms()};
+    window_used += wire.size();
+    return wire;
+}
+
+//tells a client its command numbered seq never went to the controller
+void Gateway::refuse(int fd, uint16_t seq)
+{
+    auto c = clients.find(fd);
+    if (c != clients.end())
+    {
+        send_to(fd, c->second, "<NAK," + std::to_string(seq) + "," + std::to_string(PROTO_NAK_REFUSED) + ">");
+    }
+}
+
+void Gateway::answered(std::map<uint16_t, Pending>::iterator it)
+{
+    window_used -= it->second.bytes;
+    pending.erase(it);
+}
+
+//gives up on numbered commands that went unanswered (lost on the line, or
+//sent to firmware too old to number its answers), so they neither hold the
+//window shut nor keep their entry for good. The client has its own timeout.
+void Gateway::on_expire()
+{
+    uint64_t expirations;
+    if (read(expire_fd, &expirations, sizeof(expirations)) <= 0)
+    {
+        return;
+    }
+    uint64_t now = monotonic_ms();
+    for (auto it = pending.begin(); it != pending.end();)
+    {
+        auto next = std::next(it);
+        if (now - it->second.sent_ms >= ANSWER_TIMEOUT_MS)
+        {
+            answered(it);
+        }
+        it = next;
+    }
+    release_held();
+}
+
+//refuses every command not on the wire yet: nothing waits for the port to
+//come back (see send_command)
+void Gateway::drop_unsent()
+{
+    for (const std::string &frame : serial_out)
+    {
+        uint16_t seq;
+        auto p = frame_seq(frame, seq) ? pending.find(seq) : pending.end();
+        if (p != pending.end())
+        {
+            refuse(p->second.fd, p->second.seq);
+        }
+    }
+    serial_out.clear();
+    serial_out_sent = 0;
+    for (const Held &h : held)
+    {
+        uint16_t seq;
+        if (frame_seq(h.frame, seq))
+        {
+            refuse(h.fd, seq);
+        }
+    }
+    held.clear();
+}
+
+void Gateway::forget_pending()
+{
+    pending.clear();
+    window_used = 0;
+    release_held();
+}
+
+//hands an <ACK>/<NAK> to the client whose command it answers, under the
+//client's own sequence number; false if it isn't one
+bool Gateway::route_reply(const std::string &line)
+{
+    std::vector<std::string> frames = frames_in(line);
+    Reply reply;
+    if (frames.size() != 1 || !parse_reply(frames[0], reply))
+    {
+        return false;
+    }
+    auto it = pending.find(reply.seq);
+    if (it == pending.end())
+    {
+        return false;
+    }
+    Pending p = it->second;
+    answered(it);
+    auto c = clients.find(p.fd);
+    if (c != clients.end())
+    {
+        send_to(p.fd, c->second, frame_with_seq(frames[0], p.seq));
+    }
+    release_held();
+    return true;
+}
+
+void Gateway::flush_serial()
+{
+    if (serial_fd < 0)
+    {
+        return; //nothing goes while the port is down
+    }
+    while (!serial_out.empty())
+    {
+        const std::string &head = serial_out.front();
+        ssize_t len = write(serial_fd, head.data() + serial_out_sent, head.size() - serial_out_sent);
+        if (len < 0)
+        {
+            break;
+        }
+        serial_out_sent += len;
+        if (serial_out_sent < head.size())
+        {
+            break;
+        }
+        serial_out.pop_front();
+        serial_out_sent = 0;
+    }
+    watch(serial_fd, EPOLLIN | (serial_out.empty() ? 0u : (uint32_t)EPOLLOUT));
+}
+
+void Gateway::broadcast(const std::string &line)
+{
+    for (auto it = clients.begin(); it != clients.end();)
+    {
+        int fd = it->first;
+        Client &c = (it++)->second;
+        send_to(fd, c, line);
+    }
+}
+
+//false if the client was dropped instead
+bool Gateway::send_to(int fd, Client &c, const std::string &line)
+{
+    if (c.out.size() + line.size() + 1 > opts.client_queue_max)
+    {
+        drop_client(fd, "is not reading");
+        return false;
+    }
+    c.out += line + "\n";
+    flush_client(fd, c);
+    return true;
+}
+
+void Gateway::flush_client(int fd, Client &c)
+{
+    while (!c.out.empty())
+    {
+        ssize_t len = write(fd, c.out.data(), c.out.size());
+        if (len <= 0)
+        {
+            break;
+        }
+        c.out.erase(0, len);
+    }
+    watch(fd, EPOLLIN | (c.out.empty() ? 0u : (uint32_t)EPOLLOUT));
+}
+
+void Gateway::drop_client(int fd, const char *why)
+{
+    if (why)
+    {
+        fprintf(stderr, "gateway: dropping client %d: %s\n", fd, why);
+    }
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    clients.erase(fd);
+    //its answers still come, and then go nowhere (or time out)
+}
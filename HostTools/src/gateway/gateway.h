@@ -0,0 +1,104 @@
+#pragma once
+//Serial gateway: the one process that owns the controller's serial port.
+//Local clients connect over a Unix socket, send <...> commands and receive
+//every line the controller prints. A single epoll loop serves everything
+//non-blocking, so a stalled client can never hold up the serial link.
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <map>
+#include <string>
+#include "frame.h"
+
+class Gateway
+{
+public:
+    struct Options
+    {
+        std::string device;      //serial port or pseudo-terminal
+        std::string socket_path; //Unix socket clients connect to
+        uint32_t keepalive_ms;   //send <NOP> after this long without a command, 0=never
+        uint32_t client_idle_ms; //...but only until this long after a client's last command, 0=until it disconnects
+        size_t client_queue_max; //bytes queued to one client before it is dropped
+        std::string record_path; //session recording for anneal-sim --replay, empty=none
+    };
+
+    explicit Gateway(const Options &opts);
+    ~Gateway();
+    //serves until SIGINT/SIGTERM; returns the process exit code
+    int run();
+    //run() in steps, for tests: start() opens the socket and the port (false,
+    //after saying why, if it can't), then each poll() serves whatever is ready
+    //within timeout_ms (-1 waits) and returns -1 to carry on, else the exit code
+    bool start();
+    int poll(int timeout_ms);
+
+private:
+    struct Client
+    {
+        LineSplitter in;
+        std::string out;
+        uint64_t last_command_ms = 0; //0=has sent none
+    };
+
+    Options opts;
+    int epfd = -1, listen_fd = -1, serial_fd = -1;
+    int signal_fd = -1, keepalive_fd = -1, reconnect_fd = -1, expire_fd = -1;
+    bool serial_missing = false; //open failure already reported
+    LineSplitter serial_in;
+    std::deque<std::string> serial_out; //frames waiting for the UART, head may be partly sent
+    size_t serial_out_sent = 0;
+    uint64_t last_command_ms = 0;
+    FILE *record = nullptr;
+    std::map<int, Client> clients;
+    //commands with a sequence number go out under one of ours, so two clients
+    //counting from 1 don't get each other's <ACK>s: ours -> client and its own
+    struct Pending
+    {
+        int fd;
+        uint16_t seq;
+        size_t bytes; //of the frame on the wire
+        uint64_t sent_ms;
+    };
+    std::map<uint16_t, Pending> pending;
+    uint16_t next_seq = 0;
+    //pending bytes are bounded by ANNEAL_RX_WINDOW over all clients together;
+    //commands past it wait here in arrival order, unnumbered ones included
+    struct Held
+    {
+        int fd;
+        std::string frame;
+    };
+    std::deque<Held> held;
+    size_t window_used = 0;
+
+    bool setup();
+    bool open_serial();
+    void close_serial();
+    void watch(int fd, uint32_t events);
+    void arm_timer(int fd, uint32_t first_ms, uint32_t interval_ms);
+
+    void on_serial(uint32_t events);
+    void on_accept();
+    void on_client(int fd, uint32_t events);
+    void on_keepalive();
+    bool in_charge();
+
+    void record_line(char dir, const std::string &line);
+    void send_command(const std::string &frame);
+    void forward_command(int fd, const std::string &frame);
+    uint16_t free_seq();
+    std::string number(int fd, uint16_t seq, const std::string &frame);
+    void refuse(int fd, uint16_t seq);
+    void release_held();
+    void answered(std::map<uint16_t, Pending>::iterator it);
+    void on_expire();
+    void drop_unsent();
+    void forget_pending();
+    bool route_reply(const std::string &line);
+    void flush_serial();
+    void broadcast(const std::string &line);
+    bool send_to(int fd, Client &c, const std::string &line);
+    void flush_client(int fd, Client &c);
+    void drop_client(int fd, const char *why);
+};
@@ -0,0 +1,71 @@
+//anneal-gateway: owns the controller's serial port and shares it with local clients
+#include "gateway.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s -d DEVICE [-s SOCKET] [-k SECONDS] [-i SECONDS] [-q BYTES] [-r FILE]\n"
+            "  -d DEVICE   controller serial port, or the simulator's pseudo-terminal\n"
+            "  -s SOCKET   Unix socket for clients (default /tmp/anneal-gateway.sock)\n"
+            "  -k SECONDS  keepalive interval, 0 to disable (default 2)\n"
+            "  -i SECONDS  stop the keepalive this long after a client's last command\n"
+            "              (default 0: once no client that has sent commands is connected)\n"
+            "  -q BYTES    output queued to a client before it is dropped (default 65536)\n"
+            "  -r FILE     append the session to FILE for the simulator's --replay\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    Gateway::Options opts;
+    opts.socket_path = "/tmp/anneal-gateway.sock";
+    opts.keepalive_ms = 2000;
+    opts.client_idle_ms = 0;
+    opts.client_queue_max = 65536;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:s:k:i:q:r:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            opts.device = optarg;
+            break;
+        case 's':
+            opts.socket_path = optarg;
+            break;
+        case 'k':
+            //must stay well inside the firmware's 10s COMMS_TIMEOUT
+            opts.keepalive_ms = (uint32_t)(atof(optarg) * 1000);
+            if (opts.keepalive_ms > 8000)
+            {
+                fprintf(stderr, "%s: keepalive interval must be under 8s\n", argv[0]);
+                return 1;
+            }
+            break;
+        case 'i':
+            opts.client_idle_ms = (uint32_t)(atof(optarg) * 1000);
+            break;
+        case 'q':
+            opts.client_queue_max = strtoul(optarg, nullptr, 0);
+            break;
+        case 'r':
+            opts.record_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (opts.device.empty())
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Gateway gw(opts);
+    return gw.run();
+}
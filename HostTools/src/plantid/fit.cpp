@@ -0,0 +1,243 @@
+#include "fit.h"
+#include <algorithm>
+#include <math.h>
+
+#define MIN_TRANSITIONS 60 //a minute of data per parameter is little enough
+#define MIN_DUTY_SPREAD 1  //% duty, standard deviation that counts as excitation
+
+//regressors, in the order of the normal equations
+#define COL_T 0
+#define COL_UA 1
+#define COL_UB 2
+#define COL_C 3
+#define COLS 4
+
+//solves G*x = h in place for the n columns listed in cols; false if singular
+static bool solve(double G[COLS][COLS], double h[COLS], const uint8_t *cols, uint8_t n, double x[COLS])
+{
+    double A[COLS][COLS + 1];
+    for (uint8_t i = 0; i < n; i++)
+    {
+        for (uint8_t j = 0; j < n; j++)
+        {
+            A[i][j] = G[cols[i]][cols[j]];
+        }
+        A[i][n] = h[cols[i]];
+    }
+    for (uint8_t p = 0; p < n; p++)
+    {
+        uint8_t best = p;
+        for (uint8_t i = p + 1; i < n; i++)
+        {
+            if (fabs(A[i][p]) > fabs(A[best][p]))
+            {
+                best = i;
+            }
+        }
+        if (fabs(A[best][p]) < 1e-12 * (fabs(G[cols[p]][cols[p]]) + 1))
+        {
+            return false;
+        }
+        std::swap(A[p], A[best]);
+        for (uint8_t i = p + 1; i < n; i++)
+        {
+            double f = A[i][p] / A[p][p];
+            for (uint8_t j = p; j <= n; j++)
+            {
+                A[i][j] -= f * A[p][j];
+            }
+        }
+    }
+    for (int i = n - 1; i >= 0; i--)
+    {
+        double s = A[i][n];
+        for (uint8_t j = i + 1; j < n; j++)
+        {
+            s -= A[i][j] * x[cols[j]];
+        }
+        x[cols[i]] = s / A[i][i];
+    }
+    return true;
+}
+
+bool plant_fit(const std::vector<PlantSample> &samples, float Ts, unsigned max_dead, PlantFit &fit, std::string &err)
+{
+    const unsigned L = max_dead;
+    //transitions k -> k+1 inside one run, with L samples of history before k;
+    //every pair of dead times is judged on the same ones
+    std::vector<size_t> ks;
+    size_t run_start = 0;
+    for (size_t k = 0; k + 1 < samples.size(); k++)
+    {
+        if (samples[k].starts_run)
+        {
+            run_start = k;
+        }
+        if (!samples[k + 1].starts_run && k - run_start >= L)
+        {
+            ks.push_back(k);
+        }
+    }
+    if (ks.size() < MIN_TRANSITIONS)
+    {
+        err = "only " + std::to_string(ks.size()) + " usable samples (runs shorter than the longest dead time tried don't count)";
+        return false;
+    }
+    const double n = ks.size();
+
+    //sums that don't depend on the dead times
+    double sT[2] = {}, sTT[2] = {}, sy[2] = {}, syy[2] = {}, sTy[2] = {};
+    for (size_t k : ks)
+    {
+        for (uint8_t z = 0; z < 2; z++)
+        {
+            double T = samples[k].temp[z], y = samples[k + 1].temp[z];
+            sT[z] += T;
+            sTT[z] += T * T;
+            sy[z] += y;
+            syy[z] += y * y;
+            sTy[z] += T * y;
+        }
+    }
+    //a heater that sat at one duty throughout can't be told apart from T0
+    for (uint8_t h = 0; h < 2; h++)
+    {
+        double sum = 0, sq = 0;
+        for (size_t k : ks)
+        {
+            sum += samples[k].duty[h];
+            sq += (double)samples[k].duty[h] * samples[k].duty[h];
+        }
+        double mean = sum / n;
+        fit.excited[h] = sqrt(std::max(sq / n - mean * mean, 0.0)) >= MIN_DUTY_SPREAD;
+    }
+    unsigned lags[2] = {fit.excited[0] ? L + 1 : 1, fit.excited[1] ? L + 1 : 1};
+
+    //sums with one heater's duty at each lag: su, suu, suT[z], suy[z]
+    std::vector<double> su[2], suu[2], suT[2][2], suy[2][2];
+    for (uint8_t h = 0; h < 2; h++)
+    {
+        su[h].assign(lags[h], 0);
+        suu[h].assign(lags[h], 0);
+        for (uint8_t z = 0; z < 2; z++)
+        {
+            suT[z][h].assign(lags[h], 0);
+            suy[z][h].assign(lags[h], 0);
+        }
+        for (unsigned lag = 0; lag < lags[h]; lag++)
+        {
+            for (size_t k : ks)
+            {
+                double u = samples[k - lag].duty[h];
+                su[h][lag] += u;
+                suu[h][lag] += u * u;
+                for (uint8_t z = 0; z < 2; z++)
+                {
+                    suT[z][h][lag] += u * samples[k].temp[z];
+                    suy[z][h][lag] += u * samples[k + 1].temp[z];
+                }
+            }
+        }
+    }
+    //and the one term with both heaters, per pair of lags
+    std::vector<double> sAB(lags[0] * lags[1], 0);
+    for (unsigned la = 0; la < lags[0]; la++)
+    {
+        for (unsigned lb = 0; lb < lags[1]; lb++)
+        {
+            double s = 0;
+            for (size_t k : ks)
+            {
+                s += (double)samples[k - la].duty[0] * samples[k - lb].duty[1];
+            }
+            sAB[la * lags[1] + lb] = s;
+        }
+    }
+
+    uint8_t cols[COLS], ncols = 0;
+    cols[ncols++] = COL_T;
+    if (fit.excited[0])
+    {
+        cols[ncols++] = COL_UA;
+    }
+    if (fit.excited[1])
+    {
+        cols[ncols++] = COL_UB;
+    }
+    cols[ncols++] = COL_C;
+
+    //one zone's least squares for a pair of lags; false if singular
+    auto zone_fit = [&](uint8_t z, unsigned la, unsigned lb, double x[COLS], double &sse) {
+        double G[COLS][COLS] = {
+            {sTT[z], suT[z][0][la], suT[z][1][lb], sT[z]},
+            {suT[z][0][la], suu[0][la], sAB[la * lags[1] + lb], su[0][la]},
+            {suT[z][1][lb], sAB[la * lags[1] + lb], suu[1][lb], su[1][lb]},
+            {sT[z], su[0][la], su[1][lb], n}};
+        double h[COLS] = {sTy[z], suy[z][0][la], suy[z][1][lb], sy[z]};
+        for (uint8_t i = 0; i < COLS; i++)
+        {
+            x[i] = 0;
+        }
+        if (!solve(G, h, cols, ncols, x))
+        {
+            return false;
+        }
+        //at the optimum the residual is y'y - x'h
+        sse = syy[z];
+        for (uint8_t i = 0; i < ncols; i++)
+        {
+            sse -= x[cols[i]] * h[cols[i]];
+        }
+        return true;
+    };
+
+    double best_sse = INFINITY;
+    unsigned best[2] = {0, 0};
+    for (unsigned la = 0; la < lags[0]; la++)
+    {
+        for (unsigned lb = 0; lb < lags[1]; lb++)
+        {
+            double x[COLS], sse_A, sse_B;
+            if (zone_fit(0, la, lb, x, sse_A) && zone_fit(1, la, lb, x, sse_B) && sse_A + sse_B < best_sse)
+            {
+                best_sse = sse_A + sse_B;
+                best[0] = la;
+                best[1] = lb;
+            }
+        }
+    }
+    if (best_sse == INFINITY)
+    {
+        err = "the data can't separate the parameters (temperatures constant, or duties tracking each other exactly)";
+        return false;
+    }
+
+    for (uint8_t z = 0; z < 2; z++)
+    {
+        double x[COLS], sse;
+        zone_fit(z, best[0], best[1], x, sse);
+        double a = x[COL_T];
+        if (!(a > 0 && a < 1))
+        {
+            err = std::string("zone ") + (char)('A' + z) + " doesn't settle like a first-order lag (a = " + std::to_string(a) + ")";
+            return false;
+        }
+        fit.tau[z] = -Ts / log(a);
+        fit.K[z][0] = x[COL_UA] / (1 - a);
+        fit.K[z][1] = x[COL_UB] / (1 - a);
+        fit.T0[z] = x[COL_C] / (1 - a);
+        fit.rms[z] = sqrt(std::max(sse, 0.0) / n);
+        fit.dead[z] = best[z] * Ts;
+    }
+
+    std::vector<float> cj;
+    cj.reserve(samples.size());
+    for (const PlantSample &s : samples)
+    {
+        cj.push_back(s.internal);
+    }
+    std::nth_element(cj.begin(), cj.begin() + cj.size() / 2, cj.end());
+    fit.T_cj = cj[cj.size() / 2];
+    fit.used = ks.size();
+    return true;
+}
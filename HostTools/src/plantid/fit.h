@@ -0,0 +1,41 @@
+#pragma once
+//Identification of the two-zone thermal model the simulator runs (see
+//sim_plant.cpp): each zone relaxes towards T0 + K*duty with its own time
+//constant, and each heater's output reaches both zones after its own dead
+//time. Sampled once per control period that is, exactly,
+//
+//  T[k+1] = a*T[k] + b_A*u_A[k - n_A] + b_B*u_B[k - n_B] + c
+//
+//with a = exp(-Ts/tau), b = K*(1 - a), c = T0*(1 - a): linear least squares
+//for every pair of dead times (n_A, n_B). The sums the normal equations need
+//are worked out once per lag (and once per pair for the A*B term), so a grid
+//of dead times over a day of 1Hz data takes well under a second.
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct PlantSample
+{
+    float temp[2];  //degC, zone A and B
+    float duty[2];  //% heater duty, A and B
+    float internal; //degC, ADC (cold junction)
+    bool starts_run; //not a continuation of the sample before it (reboot, gap, error)
+};
+
+struct PlantFit
+{
+    float tau[2];  //s, zone time constants
+    float dead[2]; //s, heater dead times, to the nearest period
+    float K[2][2]; //degC per % duty, zone first, heater second
+    float T0[2];   //degC with both heaters off
+    float T_cj;    //degC, median cold junction temperature
+    float rms[2];  //degC, one-step-ahead residual per zone
+    size_t used;   //transitions the fit is based on
+    bool excited[2]; //heater's duty varied enough to tell its gains apart
+};
+
+//Ts: sampling period, s. max_dead: longest dead time tried, in periods.
+//False, with the reason in err, when there is too little data or a zone
+//doesn't behave like a first-order lag (no decay between samples).
+bool plant_fit(const std::vector<PlantSample> &samples, float Ts, unsigned max_dead, PlantFit &fit, std::string &err);
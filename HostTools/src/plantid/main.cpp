@@ -0,0 +1,226 @@
+//anneal-plantid: fits the simulator's thermal model to recorded telemetry
+#include "fit.h"
+#include "frame.h"
+#include "telemetry.h"
+#include "tslog.h"
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+
+#define PERIOD_S 1.0 //LOOP_PERIOD in the firmware: one <DAT> per period
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-o FILE] [-d SECONDS] LOG...\n"
+            "  LOG         tslog file, gateway recording (-r) or anything else with <DAT> lines in it\n"
+            "  -o FILE     write the model there instead of to stdout\n"
+            "  -d SECONDS  longest heater dead time to try (default 30)\n"
+            "the model file is what the simulator's --plant takes\n",
+            prog);
+}
+
+//collects <DAT> samples, starting a new run wherever the controller
+//rebooted, reported an error or a period went missing
+class Collector
+{
+public:
+    std::vector<PlantSample> samples;
+
+    void dat(const DatFrame &d)
+    {
+        //0 means nothing converted yet, or a wild reading
+        if (d.temp_A == 0 || d.temp_B == 0 || isnan(d.duty_A) || isnan(d.duty_B))
+        {
+            broken = true;
+            return;
+        }
+        PlantSample s = {{d.temp_A, d.temp_B}, {d.duty_A, d.duty_B}, d.internal, true};
+        float gap = d.uptime - last_uptime;
+        s.starts_run = broken || gap < 0.5 * PERIOD_S || gap > 1.5 * PERIOD_S;
+        samples.push_back(s);
+        last_uptime = d.uptime;
+        broken = false;
+    }
+
+    //heaters off and the readings suspect until the next good <DAT>
+    void interrupt() { broken = true; }
+
+private:
+    float last_uptime = -1;
+    bool broken = true;
+};
+
+static bool read_tslog(const char *path, Collector &c)
+{
+    TsLogReader log;
+    std::string err;
+    if (!log.open(path, err))
+    {
+        return false;
+    }
+    uint32_t run = UINT32_MAX;
+    log.scan_time(INT64_MIN, INT64_MAX, UINT32_MAX, [&](const TsRow &row) {
+        if (row.run != run || row.kind == TSLOG_KIND_ERR)
+        {
+            c.interrupt();
+            run = row.run;
+        }
+        if (row.kind == TSLOG_KIND_DAT)
+        {
+            DatFrame d;
+            d.uptime = row.uptime;
+            d.temp_A = row.temp_A;
+            d.temp_B = row.temp_B;
+            d.internal = row.internal;
+            d.duty_A = row.duty_A;
+            d.duty_B = row.duty_B;
+            c.dat(d); //the rest isn't needed here
+        }
+        return true;
+    });
+    c.interrupt();
+    return true;
+}
+
+static bool read_text(const char *path, Collector &c)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.find("boot") != std::string::npos)
+        {
+            c.interrupt();
+        }
+        for (const std::string &frame : frames_in(line))
+        {
+            DatFrame d;
+            ErrFrame e;
+            if (parse_dat(frame, d))
+            {
+                c.dat(d);
+            }
+            else if (parse_err(frame, e))
+            {
+                c.interrupt();
+            }
+        }
+    }
+    c.interrupt();
+    return true;
+}
+
+//SIMC rules (Skogestad) for one zone's own heater: closed loop about as fast
+//as the dead time allows, which suits the slow zones without overshoot
+static void simc_gains(const PlantFit &fit, uint8_t z, float &Kp, float &Ki)
+{
+    //sample and hold adds half a period to the dead time
+    float theta = fit.dead[z] + PERIOD_S / 2;
+    float tau_c = std::max(theta, (float)PERIOD_S);
+    Kp = fit.tau[z] / (fit.K[z][z] * (tau_c + theta));
+    Ki = Kp / std::min(fit.tau[z], 4 * (tau_c + theta));
+}
+
+static void write_model(FILE *f, const PlantFit &fit, const std::string &sources)
+{
+    fprintf(f, "# anneal-plantid: %zu periods from %s\n", fit.used, sources.c_str());
+    fprintf(f, "# one-step rms error: A %.3f degC, B %.3f degC\n", fit.rms[0], fit.rms[1]);
+    for (uint8_t h = 0; h < 2; h++)
+    {
+        if (!fit.excited[h])
+        {
+            fprintf(f, "# heater %c never changed its duty: its gains and dead time are unknown, set to 0\n", 'A' + h);
+        }
+    }
+    fprintf(f, "tau_A = %.2f\ntau_B = %.2f\n", fit.tau[0], fit.tau[1]);
+    fprintf(f, "dead_A = %.0f\ndead_B = %.0f\n", fit.dead[0], fit.dead[1]);
+    fprintf(f, "K_AA = %.4f\nK_AB = %.4f\nK_BA = %.4f\nK_BB = %.4f\n", fit.K[0][0], fit.K[0][1], fit.K[1][0], fit.K[1][1]);
+    fprintf(f, "T0_A = %.2f\nT0_B = %.2f\n", fit.T0[0], fit.T0[1]);
+    fprintf(f, "T_cj = %.2f\n", fit.T_cj);
+
+    //the same numbers as controller commands
+    fprintf(f, "# <DCM,%.4f,%.4f,%.4f,%.4f>\n", fit.K[0][0], fit.K[0][1], fit.K[1][0], fit.K[1][1]);
+    for (uint8_t z = 0; z < 2; z++)
+    {
+        fprintf(f, "# <FFM,%c,%.4f,%.2f>\n", 'A' + z, fit.K[z][0] + fit.K[z][1], fit.T0[z]);
+    }
+    if (fit.K[0][0] > 0 && fit.K[1][1] > 0)
+    {
+        //both loops share one set of gains: the gentler of the two
+        float Kp[2], Ki[2];
+        simc_gains(fit, 0, Kp[0], Ki[0]);
+        simc_gains(fit, 1, Kp[1], Ki[1]);
+        fprintf(f, "# <PID,%.4f,%.5f,0.0>\n", std::min(Kp[0], Kp[1]), std::min(Ki[0], Ki[1]));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *out_path = nullptr;
+    float max_dead_s = 30;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:d:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'd':
+            max_dead_s = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc || max_dead_s < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Collector c;
+    std::string sources;
+    for (int i = optind; i < argc; i++)
+    {
+        if (!read_tslog(argv[i], c) && !read_text(argv[i], c))
+        {
+            fprintf(stderr, "%s: cannot read %s: %s\n", argv[0], argv[i], strerror(errno));
+            return 1;
+        }
+        sources += (sources.empty() ? "" : ", ") + std::string(argv[i]);
+    }
+
+    PlantFit fit;
+    std::string err;
+    if (!plant_fit(c.samples, PERIOD_S, (unsigned)lround(max_dead_s / PERIOD_S), fit, err))
+    {
+        fprintf(stderr, "%s: %s\n", argv[0], err.c_str());
+        return 1;
+    }
+
+    FILE *f = out_path ? fopen(out_path, "w") : stdout;
+    if (!f)
+    {
+        fprintf(stderr, "%s: %s: %s\n", argv[0], out_path, strerror(errno));
+        return 1;
+    }
+    write_model(f, fit, sources);
+    if (f != stdout)
+    {
+        fclose(f);
+    }
+    return 0;
+}
@@ -0,0 +1,400 @@
+//anneal-tslog: records controller telemetry into a memory-mapped log and queries it
+#include "frame.h"
+#include "telemetry.h"
+#include "tslog.h"
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#define FLUSH_INTERVAL_US 1000000
+
+static volatile sig_atomic_t stop_requested;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static int64_t realtime_us()
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: tslog record FILE [-s SOCKET]\n"
+            "       tslog query FILE [--from T] [--to T] [--run N|--last-run] [--err] [--cols C,...]\n"
+            "       tslog info FILE\n"
+            "times T are unix seconds, \"YYYY-MM-DD HH:MM[:SS]\" local time, or -SECONDS before the end of the log\n"
+            "columns: t run kind uptime setpoint temp_A temp_B internal duty_A duty_B Kp Ki Kd adc_err fuses gradient\n");
+}
+
+static int connect_gateway(const char *path)
+{
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)))
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int cmd_record(int argc, char **argv)
+{
+    if (argc < 1)
+    {
+        usage();
+        return 1;
+    }
+    const char *file = argv[0];
+    const char *sock = "/tmp/anneal-gateway.sock";
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc)
+        {
+            sock = argv[++i];
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    TsLogWriter log;
+    std::string err;
+    if (!log.open(file, err))
+    {
+        fprintf(stderr, "tslog: %s\n", err.c_str());
+        return 1;
+    }
+
+    struct sigaction sa = {};
+    sa.sa_handler = on_signal; //no SA_RESTART: a signal interrupts the blocking read
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    uint32_t run = log.last_run();
+    float last_uptime = log.last_uptime();
+    bool booted = log.rows() == 0; //a fresh file starts at run 0 without counting a reboot
+    int64_t last_flush = realtime_us();
+    bool warned = false;
+
+    while (!stop_requested)
+    {
+        int fd = connect_gateway(sock);
+        if (fd < 0)
+        {
+            if (!warned)
+            {
+                fprintf(stderr, "tslog: cannot reach gateway at %s, retrying\n", sock);
+                warned = true;
+            }
+            sleep(1);
+            continue;
+        }
+        warned = false;
+        fprintf(stderr, "tslog: recording to %s\n", file);
+
+        LineSplitter lines;
+        char buf[4096];
+        ssize_t len;
+        while (!stop_requested && (len = read(fd, buf, sizeof(buf))) > 0)
+        {
+            lines.feed(buf, len);
+            std::string line;
+            while (lines.next(line))
+            {
+                TsRow row;
+                memset(&row, 0, sizeof(row));
+                row.t_us = realtime_us();
+                DatFrame dat;
+                ErrFrame e;
+                if (line == "boot")
+                {
+                    booted = true;
+                    continue;
+                }
+                else if (parse_dat(line, dat))
+                {
+                    //the controller rebooted if it says so, or if its clock went backwards
+                    if (!booted && (dat.uptime < last_uptime))
+                    {
+                        booted = true;
+                    }
+                    if (booted && log.rows() > 0)
+                    {
+                        run++;
+                    }
+                    booted = false;
+                    last_uptime = dat.uptime;
+                    row.kind = TSLOG_KIND_DAT;
+                    row.uptime = dat.uptime;
+                    row.setpoint = dat.setpoint;
+                    row.temp_A = dat.temp_A;
+                    row.temp_B = dat.temp_B;
+                    row.internal = dat.internal;
+                    row.duty_A = dat.duty_A;
+                    row.duty_B = dat.duty_B;
+                    row.Kp = dat.Kp;
+                    row.Ki = dat.Ki;
+                    row.Kd = dat.Kd;
+                    row.gradient = dat.gradient;
+                }
+                else if (parse_err(line, e))
+                {
+                    row.kind = TSLOG_KIND_ERR;
+                    row.uptime = row.setpoint = row.temp_A = row.temp_B = row.internal = NAN;
+                    row.duty_A = row.duty_B = row.Kp = row.Ki = row.Kd = row.gradient = NAN;
+                    row.adc_err = e.adc_err;
+                    row.fuses = e.fuses;
+                }
+                else
+                {
+                    continue; //other traffic (replies, debug output) isn't telemetry
+                }
+                row.run = run;
+                if (!log.append(row, err))
+                {
+                    fprintf(stderr, "tslog: %s: %s\n", file, err.c_str());
+                    close(fd);
+                    return 1;
+                }
+            }
+            int64_t now = realtime_us();
+            if (now - last_flush >= FLUSH_INTERVAL_US)
+            {
+                log.flush();
+                last_flush = now;
+            }
+        }
+        close(fd);
+        if (!stop_requested)
+        {
+            fprintf(stderr, "tslog: gateway went away, reconnecting\n");
+            sleep(1);
+        }
+    }
+    log.flush();
+    return 0;
+}
+
+//unix seconds, local "YYYY-MM-DD HH:MM[:SS]", or -SECONDS before end
+static bool parse_time(const char *s, int64_t end, int64_t &t)
+{
+    char *rest;
+    double v = strtod(s, &rest);
+    if (*rest == '\0' && rest != s)
+    {
+        t = s[0] == '-' ? end + (int64_t)(v * 1e6) : (int64_t)(v * 1e6);
+        return true;
+    }
+    struct tm tm = {};
+    tm.tm_isdst = -1;
+    const char *tail = strptime(s, "%Y-%m-%d %H:%M:%S", &tm);
+    if (!tail || *tail)
+    {
+        memset(&tm, 0, sizeof(tm));
+        tm.tm_isdst = -1;
+        tail = strptime(s, "%Y-%m-%d %H:%M", &tm);
+    }
+    if (!tail || *tail)
+    {
+        return false;
+    }
+    t = (int64_t)mktime(&tm) * 1000000;
+    return true;
+}
+
+static std::string format_time(int64_t t_us)
+{
+    time_t secs = t_us / 1000000;
+    struct tm tm;
+    localtime_r(&secs, &tm);
+    char buf[32];
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    return buf;
+}
+
+static int cmd_query(int argc, char **argv)
+{
+    if (argc < 1)
+    {
+        usage();
+        return 1;
+    }
+    TsLogReader log;
+    std::string err;
+    if (!log.open(argv[0], err))
+    {
+        fprintf(stderr, "tslog: %s\n", err.c_str());
+        return 1;
+    }
+
+    int64_t t0 = INT64_MIN, t1 = INT64_MAX;
+    uint32_t run = UINT32_MAX;
+    bool errors_only = false;
+    std::vector<int> cols;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--from" && has_value && parse_time(argv[i + 1], log.last_time(), t0))
+        {
+            i++;
+        }
+        else if (arg == "--to" && has_value && parse_time(argv[i + 1], log.last_time(), t1))
+        {
+            i++;
+        }
+        else if (arg == "--run" && has_value)
+        {
+            run = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--last-run")
+        {
+            run = log.last_run();
+        }
+        else if (arg == "--err")
+        {
+            errors_only = true;
+        }
+        else if (arg == "--cols" && has_value)
+        {
+            std::string list = argv[++i];
+            size_t pos = 0;
+            while (pos <= list.size())
+            {
+                size_t end = list.find(',', pos);
+                if (end == std::string::npos)
+                {
+                    end = list.size();
+                }
+                int c = tslog_column_by_name(list.substr(pos, end - pos));
+                if (c < 0)
+                {
+                    fprintf(stderr, "tslog: no column %s\n", list.substr(pos, end - pos).c_str());
+                    return 1;
+                }
+                cols.push_back(c);
+                pos = end + 1;
+            }
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (cols.empty())
+    {
+        if (errors_only)
+        {
+            cols = {TSCOL_T, TSCOL_RUN, TSCOL_ADC_ERR, TSCOL_FUSES};
+        }
+        else
+        {
+            for (int c = 0; c < TSCOL_COUNT; c++)
+            {
+                cols.push_back(c);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < cols.size(); i++)
+    {
+        printf("%s%s", i ? "," : "", tslog_column_name(cols[i]));
+    }
+    printf("\n");
+    auto emit = [&](const TsRow &row) {
+        if (row.t_us < t0 || row.t_us >= t1)
+        {
+            return row.t_us < t1;
+        }
+        for (size_t i = 0; i < cols.size(); i++)
+        {
+            printf("%s%s", i ? "," : "", tslog_format(row, cols[i]).c_str());
+        }
+        printf("\n");
+        return true;
+    };
+    if (errors_only)
+    {
+        log.scan_errors(run, emit);
+    }
+    else
+    {
+        log.scan_time(t0, t1, run, emit);
+    }
+    return 0;
+}
+
+static int cmd_info(int argc, char **argv)
+{
+    if (argc != 1)
+    {
+        usage();
+        return 1;
+    }
+    TsLogReader log;
+    std::string err;
+    if (!log.open(argv[0], err))
+    {
+        fprintf(stderr, "tslog: %s\n", err.c_str());
+        return 1;
+    }
+    printf("rows:   %llu in %llu blocks\n", (unsigned long long)log.rows(), (unsigned long long)log.blocks());
+    if (log.empty())
+    {
+        return 0;
+    }
+    printf("from:   %s\n", format_time(log.first_time()).c_str());
+    printf("to:     %s\n", format_time(log.last_time()).c_str());
+    printf("runs:   %u\n", log.last_run() + 1);
+    int64_t r0, r1;
+    if (log.run_span(log.last_run(), r0, r1))
+    {
+        printf("latest: run %u, %s to %s\n", log.last_run(), format_time(r0).c_str(), format_time(r1).c_str());
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        usage();
+        return 1;
+    }
+    std::string cmd = argv[1];
+    if (cmd == "record")
+    {
+        return cmd_record(argc - 2, argv + 2);
+    }
+    else if (cmd == "query")
+    {
+        return cmd_query(argc - 2, argv + 2);
+    }
+    else if (cmd == "info")
+    {
+        return cmd_info(argc - 2, argv + 2);
+    }
+    usage();
+    return 1;
+}
@@ -0,0 +1,298 @@
+//The gateway between clients and a pseudo-terminal standing in for the
+//controller: what goes out on the wire, in what order, and what comes back.
+//Run with `pio test -e test`.
+#include "gateway.h"
+#include "command.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <unity.h>
+
+#define SOCKET_PATH "/tmp/anneal-gateway-test.sock"
+#define DEVICE_PATH "/tmp/anneal-gateway-test.tty" //to the current pty, like anneal-sim --link
+
+static int controller = -1; //pty master: what the firmware would see
+static Gateway *gw;
+
+//a new "controller" behind DEVICE_PATH
+static void plug_in()
+{
+    controller = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    TEST_ASSERT_TRUE(controller >= 0 && grantpt(controller) == 0 && unlockpt(controller) == 0);
+    unlink(DEVICE_PATH);
+    TEST_ASSERT_EQUAL_INT(0, symlink(ptsname(controller), DEVICE_PATH));
+}
+
+static void unplug()
+{
+    close(controller);
+    controller = -1;
+}
+
+static Gateway::Options options()
+{
+    Gateway::Options opts;
+    opts.socket_path = SOCKET_PATH;
+    opts.keepalive_ms = 0;
+    opts.client_idle_ms = 0;
+    opts.client_queue_max = 65536;
+    return opts;
+}
+
+static void start(const Gateway::Options &opts)
+{
+    plug_in();
+    Gateway::Options o = opts;
+    o.device = DEVICE_PATH;
+    gw = new Gateway(o);
+    TEST_ASSERT_TRUE(gw->start());
+}
+
+void setUp() {}
+
+void tearDown()
+{
+    delete gw;
+    gw = nullptr;
+    if (controller >= 0)
+    {
+        unplug();
+    }
+    unlink(DEVICE_PATH);
+}
+
+static uint64_t now_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//lets the gateway serve everything that comes up within ms
+static void pump(uint32_t ms)
+{
+    uint64_t end = now_ms() + ms;
+    while (now_ms() < end)
+    {
+        TEST_ASSERT_EQUAL_INT(-1, gw->poll(5));
+    }
+}
+
+static int connect_client()
+{
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, SOCKET_PATH);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    TEST_ASSERT_EQUAL_INT(0, connect(fd, (sockaddr *)&addr, sizeof(addr)));
+    pump(20);
+    return fd;
+}
+
+static void put(int fd, const std::string &text)
+{
+    TEST_ASSERT_EQUAL_INT((int)text.size(), write(fd, text.data(), text.size()));
+}
+
+//everything readable on fd so far, as frames
+static std::vector<std::string> take(int fd)
+{
+    std::string text;
+    char buf[1024];
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+    {
+        text.append(buf, len);
+    }
+    return frames_in(text);
+}
+
+static int find_tag(const std::vector<std::string> &frames, const char *tag)
+{
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        if (frame_tag(frames[i]) == tag)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//answers every numbered command like the firmware: <ACK,seq,TAG>
+static void acknowledge(const std::vector<std::string> &frames)
+{
+    for (const std::string &f : frames)
+    {
+        uint16_t seq;
+        if (frame_seq(f, seq))
+        {
+            put(controller, "<ACK," + std::to_string(seq) + "," + frame_tag(f) + ">\r\n");
+        }
+    }
+}
+
+void test_off_overtakes_held_commands_without_being_undone()
+{
+    start(options());
+    int client = connect_client();
+    //two of these fill the receive window, so the second and the <SET> wait for the first's <ACK>
+    put(client, "<PID,10.25,0.45,17.75,#1>\n<PID,10.25,0.45,17.75,#2>\n<SET,-200.5,#3>\n<OFF,#4>\n");
+    pump(50);
+    std::vector<std::string> wire = take(controller);
+    TEST_ASSERT_EQUAL_INT(0, find_tag(wire, "PID"));
+    TEST_ASSERT_EQUAL_INT(1, find_tag(wire, "OFF"));
+    TEST_ASSERT_EQUAL_UINT(2, wire.size());
+    acknowledge(wire);
+    pump(50);
+    //the second <PID> still goes, the <SET> that would have switched the heaters back on doesn't
+    std::vector<std::string> later = take(controller);
+    TEST_ASSERT_EQUAL_UINT(1, later.size());
+    TEST_ASSERT_EQUAL_STRING("PID", frame_tag(later[0]).c_str());
+    acknowledge(later);
+    pump(50);
+
+    std::vector<std::string> replies = take(client);
+    TEST_ASSERT_EQUAL_UINT(4, replies.size());
+    bool seen[5] = {};
+    for (const std::string &r : replies)
+    {
+        Reply reply;
+        TEST_ASSERT_TRUE(parse_reply(r, reply));
+        TEST_ASSERT_TRUE(reply.seq >= 1 && reply.seq <= 4);
+        seen[reply.seq] = true;
+        //under the client's own numbers, and the <SET> refused
+        TEST_ASSERT_EQUAL(reply.seq != 3, reply.ack);
+        if (reply.seq == 3)
+        {
+            TEST_ASSERT_EQUAL_UINT8(PROTO_NAK_REFUSED, reply.code);
+        }
+    }
+    TEST_ASSERT_TRUE(seen[1] && seen[2] && seen[3] && seen[4]);
+    close(client);
+}
+
+//the reply to the client's command seq, false if there is none
+static bool reply_to(const std::vector<std::string> &frames, uint16_t seq, Reply &reply)
+{
+    for (const std::string &f : frames)
+    {
+        if (parse_reply(f, reply) && reply.seq == seq)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void test_off_overtakes_the_uart_queue_without_being_undone()
+{
+    start(options());
+    int client = connect_client();
+    //a stopped tty takes no output, so everything stays queued for the UART
+    int tty = open(DEVICE_PATH, O_RDWR | O_NOCTTY);
+    tcflow(tty, TCOOFF);
+    put(client, "<SET,-200.5>\n<NOP>\n<GRD,-200,1.5,#7>\n");
+    pump(20);
+    put(client, "<OFF>\n");
+    pump(20);
+    tcflow(tty, TCOON);
+    pump(50);
+    close(tty);
+    std::vector<std::string> wire = take(controller);
+    TEST_ASSERT_EQUAL_UINT(2, wire.size());
+    TEST_ASSERT_EQUAL_STRING("<OFF>", wire[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("<NOP>", wire[1].c_str());
+    Reply reply;
+    TEST_ASSERT_TRUE(reply_to(take(client), 7, reply));
+    TEST_ASSERT_FALSE(reply.ack);
+    close(client);
+}
+
+void test_nothing_is_queued_while_the_port_is_down()
+{
+    start(options());
+    int client = connect_client();
+    unplug();
+    pump(20);
+    put(client, "<SET,-200.5>\n<SET,-190.5,#3>\n<OFF>\n");
+    pump(20);
+    Reply reply;
+    TEST_ASSERT_TRUE(reply_to(take(client), 3, reply));
+    TEST_ASSERT_FALSE(reply.ack);
+    //once the port is back, none of it turns up late
+    plug_in();
+    pump(1200);
+    TEST_ASSERT_EQUAL_UINT(0, take(controller).size());
+    put(client, "<SET,-180.5>\n");
+    pump(20);
+    std::vector<std::string> wire = take(controller);
+    TEST_ASSERT_EQUAL_UINT(1, wire.size());
+    TEST_ASSERT_EQUAL_STRING("<SET,-180.5>", wire[0].c_str());
+    close(client);
+}
+
+static size_t count_tag(const std::vector<std::string> &frames, const char *tag)
+{
+    size_t n = 0;
+    for (const std::string &f : frames)
+    {
+        n += frame_tag(f) == tag;
+    }
+    return n;
+}
+
+void test_keepalive_only_while_a_client_is_in_charge()
+{
+    Gateway::Options opts = options();
+    opts.keepalive_ms = 40;
+    start(opts);
+    pump(200);
+    TEST_ASSERT_EQUAL_UINT(0, take(controller).size()); //nobody there
+    int logger = connect_client();
+    pump(200);
+    TEST_ASSERT_EQUAL_UINT(0, take(controller).size()); //only listening
+    int gui = connect_client();
+    put(gui, "<SET,-200.5>\n");
+    pump(200);
+    TEST_ASSERT_TRUE(count_tag(take(controller), "NOP") >= 2);
+    close(gui); //exits or crashes: the firmware's timeout must get its chance
+    pump(50);
+    take(controller);
+    pump(200);
+    TEST_ASSERT_EQUAL_UINT(0, take(controller).size());
+    close(logger);
+}
+
+void test_keepalive_stops_after_the_client_goes_quiet()
+{
+    Gateway::Options opts = options();
+    opts.keepalive_ms = 40;
+    opts.client_idle_ms = 300;
+    start(opts);
+    int gui = connect_client();
+    put(gui, "<SET,-200.5>\n");
+    pump(200);
+    TEST_ASSERT_TRUE(count_tag(take(controller), "NOP") >= 2);
+    pump(200);
+    take(controller);
+    pump(200);
+    TEST_ASSERT_EQUAL_UINT(0, take(controller).size());
+    close(gui);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_off_overtakes_held_commands_without_being_undone);
+    RUN_TEST(test_off_overtakes_the_uart_queue_without_being_undone);
+    RUN_TEST(test_nothing_is_queued_while_the_port_is_down);
+    RUN_TEST(test_keepalive_only_while_a_client_is_in_charge);
+    RUN_TEST(test_keepalive_stops_after_the_client_goes_quiet);
+    return UNITY_END();
+}
@@ -0,0 +1,198 @@
+//Round trips through the shared protocol table (AnnealFirmware/include/protocol.h):
+//what the host encodes, the firmware's decoder must read back unchanged, and
+//<DAT> packets from old and new firmware must land in the right fields.
+//Run with `pio test -e test`.
+#include "command.h"
+#include "telemetry.h"
+#include <math.h>
+#include <string.h>
+#include <unity.h>
+
+void setUp() {}
+void tearDown() {}
+
+static const uint8_t all_commands[] = {
+#define TEST_ID(tag, least, most, zones) PROTO_##tag,
+    PROTOCOL_COMMANDS(TEST_ID)
+#undef TEST_ID
+};
+
+//arguments the table allows for id: zone letters alternate A/B, numbers are
+//ones that don't survive a careless float round trip
+static std::vector<float> args_for(uint8_t id, uint8_t argc)
+{
+    std::vector<float> args;
+    for (uint8_t i = 0; i < argc; i++)
+    {
+        args.push_back(proto_is_zone_arg(id, i) ? i % 2 : -273.15f + 10.1f * i);
+    }
+    return args;
+}
+
+static void round_trip(uint8_t id, uint8_t argc, int32_t seq)
+{
+    std::vector<float> args = args_for(id, argc);
+    std::string frame = encode_command(id, args, seq);
+    TEST_ASSERT_FALSE_MESSAGE(frame.empty(), proto_tag(id));
+    Command c;
+    TEST_ASSERT_TRUE_MESSAGE(decode_command(frame, c), frame.c_str());
+    TEST_ASSERT_EQUAL_UINT8(id, c.id);
+    TEST_ASSERT_EQUAL_INT32(seq, c.seq);
+    TEST_ASSERT_EQUAL_UINT8(argc, c.argc);
+    for (uint8_t i = 0; i < argc; i++)
+    {
+        TEST_ASSERT_EQUAL_FLOAT(args[i], c.arg[i]);
+    }
+}
+
+static void least_and_most(uint8_t id, uint8_t &least, uint8_t &most)
+{
+    least = PROTO_MAX_ARGS + 1;
+    most = 0;
+    for (uint8_t n = 0; n <= PROTO_MAX_ARGS; n++)
+    {
+        if (proto_argc_ok(id, n))
+        {
+            least = n < least ? n : least;
+            most = n;
+        }
+    }
+}
+
+void test_every_command_round_trips()
+{
+    for (uint8_t id : all_commands)
+    {
+        TEST_ASSERT_EQUAL_UINT8(id, proto_lookup(proto_tag(id)));
+        uint8_t least, most;
+        least_and_most(id, least, most);
+        TEST_ASSERT_TRUE_MESSAGE(least <= most, proto_tag(id));
+        for (uint8_t n = least; n <= most; n++)
+        {
+            round_trip(id, n, PROTO_NO_SEQ);
+            round_trip(id, n, 0);
+            round_trip(id, n, PROTO_SEQ_MAX);
+        }
+    }
+}
+
+void test_encode_refuses_what_the_firmware_would()
+{
+    uint8_t least, most;
+    least_and_most(PROTO_GSE, least, most);
+    TEST_ASSERT_TRUE(encode_command(PROTO_GSE, args_for(PROTO_GSE, least - 1)).empty());
+    TEST_ASSERT_TRUE(encode_command(PROTO_OFF, {1}).empty());
+    TEST_ASSERT_TRUE(encode_command(PROTO_UNKNOWN).empty());
+    TEST_ASSERT_TRUE(encode_command(PROTO_FFM, {2, 1, 0}).empty()); //zone must be A or B
+    TEST_ASSERT_TRUE(encode_command(PROTO_NOP, {}, PROTO_SEQ_MAX + 1).empty());
+}
+
+static bool decodes(const char *frame)
+{
+    Command c;
+    return decode_command(frame, c);
+}
+
+void test_decode_rejects_bad_commands()
+{
+    TEST_ASSERT_TRUE(decodes("<SET,-200>"));
+    TEST_ASSERT_FALSE(decodes("<XYZ>"));               //unknown tag
+    TEST_ASSERT_FALSE(decodes("<SETT,-200>"));         //tag too long
+    TEST_ASSERT_FALSE(decodes("<SET>"));               //too few arguments
+    TEST_ASSERT_FALSE(decodes("<PID,1,2>"));
+    TEST_ASSERT_FALSE(decodes("<SET,-200,1>"));        //too many
+    TEST_ASSERT_FALSE(decodes("<SET,-2x0>"));          //not a number
+    TEST_ASSERT_FALSE(decodes("<SET,>"));
+    TEST_ASSERT_FALSE(decodes("<FFM,C,1,0>"));         //not a zone
+    TEST_ASSERT_FALSE(decodes("<FFM,AB,1,0>"));
+    TEST_ASSERT_FALSE(decodes("<SET,-200,#>"));        //sequence number without digits
+    TEST_ASSERT_FALSE(decodes("<SET,-200,#65536>"));   //out of range
+    TEST_ASSERT_FALSE(decodes("SET,-200"));            //no brackets
+    TEST_ASSERT_FALSE(decodes("<SET,-200"));
+    TEST_ASSERT_FALSE(decodes("<set,-200>"));
+    TEST_ASSERT_FALSE(decodes(""));
+}
+
+void test_firmware_decoder_keeps_seq_of_bad_commands()
+{
+    //so the firmware can still NAK them
+    char text[] = "XYZ,1,#9";
+    Command c;
+    TEST_ASSERT_FALSE(proto_decode(text, c));
+    TEST_ASSERT_EQUAL_INT32(9, c.seq);
+}
+
+//"<DAT,1.00,2.00,...>" with n fields, field i = i + 1
+static std::string dat_with(size_t n)
+{
+    std::string frame = "<DAT";
+    for (size_t i = 0; i < n; i++)
+    {
+        frame += "," + std::to_string(i + 1) + ".00";
+    }
+    return frame + ">";
+}
+
+void test_dat_all_fields()
+{
+    DatFrame d;
+    TEST_ASSERT_TRUE(parse_dat(dat_with(PROTO_DAT_FIELDS), d));
+    const float *f = &d.uptime;
+    for (size_t i = 0; i < PROTO_DAT_FIELDS; i++)
+    {
+        TEST_ASSERT_EQUAL_FLOAT(i + 1, f[i]);
+    }
+    //the table order is the wire order
+    TEST_ASSERT_EQUAL_FLOAT(1, d.uptime);
+    TEST_ASSERT_EQUAL_FLOAT(3, d.temp_A);
+    TEST_ASSERT_EQUAL_FLOAT(10, d.Kd);
+}
+
+void test_dat_from_older_firmware()
+{
+    DatFrame d;
+    TEST_ASSERT_TRUE(parse_dat(dat_with(PROTO_DAT_MIN_FIELDS), d));
+    const float *f = &d.uptime;
+    for (size_t i = 0; i < PROTO_DAT_MIN_FIELDS; i++)
+    {
+        TEST_ASSERT_EQUAL_FLOAT(i + 1, f[i]);
+    }
+    for (size_t i = PROTO_DAT_MIN_FIELDS; i < PROTO_DAT_FIELDS; i++)
+    {
+        TEST_ASSERT_TRUE(isnan(f[i]));
+    }
+}
+
+void test_dat_from_newer_firmware()
+{
+    DatFrame d;
+    TEST_ASSERT_TRUE(parse_dat(dat_with(PROTO_DAT_FIELDS + 2), d));
+    TEST_ASSERT_EQUAL_FLOAT(PROTO_DAT_FIELDS, (&d.uptime)[PROTO_DAT_FIELDS - 1]);
+}
+
+void test_dat_rejects_bad_frames()
+{
+    DatFrame d;
+    TEST_ASSERT_FALSE(parse_dat(dat_with(PROTO_DAT_MIN_FIELDS - 1), d)); //too few fields
+    TEST_ASSERT_FALSE(parse_dat("<DAT>", d));
+    TEST_ASSERT_FALSE(parse_dat("<XYZ,1,2,3,4,5,6,7,8,9,10>", d)); //not a DAT
+    TEST_ASSERT_FALSE(parse_dat("<DAT,1,2,3,4,5,6,7,8,9,x>", d)); //not a number
+    TEST_ASSERT_FALSE(parse_dat("<DAT,1,2,3,4,5,,7,8,9,10>", d)); //empty field
+    TEST_ASSERT_FALSE(parse_dat("DAT,1,2,3,4,5,6,7,8,9,10", d));   //no brackets
+    TEST_ASSERT_FALSE(parse_dat("<DAT,1,2,3,4,5,6,7,8,9,10", d));
+    TEST_ASSERT_TRUE(parse_dat("<DAT,1,2,3,4,5,6,7,8,nan,10>", d)); //gains from an erased EEPROM
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_every_command_round_trips);
+    RUN_TEST(test_encode_refuses_what_the_firmware_would);
+    RUN_TEST(test_decode_rejects_bad_commands);
+    RUN_TEST(test_firmware_decoder_keeps_seq_of_bad_commands);
+    RUN_TEST(test_dat_all_fields);
+    RUN_TEST(test_dat_from_older_firmware);
+    RUN_TEST(test_dat_from_newer_firmware);
+    RUN_TEST(test_dat_rejects_bad_frames);
+    return UNITY_END();
+}